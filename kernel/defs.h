@@ -2,12 +2,18 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct vma;
+struct rusage;
+struct kmem_cache;
+struct mm;
+struct files;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
 
 // bio.c
 void            binit(void);
@@ -23,7 +29,7 @@ void            consoleintr(int);
 void            consputc(int);
 
 // exec.c
-int             exec(char*, char**);
+int             exec(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -59,10 +65,28 @@ void            ramdiskinit(void);
 void            ramdiskintr(void);
 void            ramdiskrw(struct buf*);
 
+// imgcache.c
+void            imginit(void);
+void*           imgget(struct inode*, uint, uint, int);
+void*           imgput(struct inode*, uint, uint, uint, void*, int);
+void            imginval(struct inode*);
+int             statsimg(char*, int);
+
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_zeroed(void);
+void            kdup(void *);
+int             krefcnt(void *);
+void*           ksuperalloc(void);
+void            ksuperdup(void *);
+void            ksuperfree(void *);
+int             ksuperrefcnt(void *);
 void            kfree(void *);
+void*           kalloc_pages(int);
+void            kfree_pages(void *, int);
+void            kmem_drain(void);
 void            kinit(void);
+int             statskmem(char*, int);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -70,7 +94,21 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// ksm.c
+void            ksminit(void);
+void            ksmscan(void);
+int             statsksm(char*, int);
+
+// mmap.c
+struct vma*     vmalookup(struct proc*, uint64);
+uint64          mmap(uint64, int, int, struct file*, uint);
+int             munmap(uint64, uint64);
+int             vmadup(struct proc*, struct proc*);
+void            vmaclear(struct mm*);
+uint64          vmalimit(struct proc*);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -81,14 +119,32 @@ void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
 
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void*           kmalloc(uint);
+void            kmfree(void*);
+int             statsslab(char*, int);
+
+// sprintf.c
+int             snprintf(char*, int, char*, ...);
+
 // proc.c
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             clone(uint64, uint64, uint64);
+int             spawn(char*, char**, int*);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
-pagetable_t     proc_pagetable(struct proc *);
-void            proc_freepagetable(pagetable_t, uint64);
+struct mm*      mmalloc(struct proc*);
+int             mmget(struct mm*, struct proc*);
+void            mmput(struct mm*, struct proc*);
+struct files*   filesalloc(struct files*, int*);
+void            filesput(struct files*);
+struct inode*   cwd(void);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
@@ -100,10 +156,21 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeone(void*);
+int             sleeptimeout(void*, struct spinlock*, uint);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             getrusage(int, struct rusage*);
+void            setrunnable(struct proc*);
+void            cpuwake(struct cpu*);
+int             statssched(char*, int);
+void            schedtick(void);
+void            schedboost(void);
+int             setpriority(int, int);
+int             setaffinity(int, int);
+int             futex(uint64, int, int);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -115,6 +182,9 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             cansleep(void);
+void            freelock(struct spinlock*);
+int             statslock(char*, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -122,12 +192,33 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// stats.c
+void            statsinit(void);
+
+// swap.c
+void            swapinit(void);
+int             swapalloc(void);
+void            swapdup(int);
+void            swapfree(int);
+void            swapin(int, void*);
+int             reclaim(void);
+int             statsswap(char*, int);
+
+// timer.c
+void            timerwheelinit(void);
+void            timeradd(struct timer*, uint, void (*)(void*), void*);
+int             timerdel(struct timer*);
+void            timertick(uint);
+int             timernext(uint*);
+int             statstimer(char*, int);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
 void*           memset(void*, int, uint);
 char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
+uint            strnlen(const char*, uint);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
@@ -156,6 +247,9 @@ int             uartgetc(void);
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+uint64          uvmsatp(struct proc*);
+void            tlbshootdown(struct mm*);
+void            tlbsync(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
@@ -163,13 +257,27 @@ void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopyrange(pagetable_t, pagetable_t, uint64, uint64, int);
+int             cowfault(pte_t*, uint64*);
+void            cowput(uint64);
+void            cowdrain(struct proc*);
 void            uvmfree(pagetable_t, uint64);
-void            uvmunmap(pagetable_t, uint64, uint64, int);
+int             uvmunmap(pagetable_t, uint64, uint64, int);
+int             uvmsplit(pagetable_t, uint64);
+int             uvmunmapsync(struct mm*, uint64, uint64);
 void            uvmclear(pagetable_t, uint64);
+pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
+int             uvmfault(struct proc*, uint64, int);
+void            uvmtouch(struct proc*, uint64, uint64, int);
+uint64          uvmword(struct proc*, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+int             statsvm(char*, int);
+pte_t *         uvmnext(pagetable_t, uint64*);
+void            uvmusage(pagetable_t, struct rusage*);
+int             uvmevict(struct proc*, uint64*, int*, int);
 
 // plic.c
 void            plicinit(void);
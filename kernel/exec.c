@@ -7,10 +7,23 @@
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
+// Drop the inode references held by n regions.
+static void
+putsegs(struct vma *segs, int n)
+{
+  begin_op();
+  for(int i = 0; i < n; i++)
+    if(segs[i].ip)
+      iput(segs[i].ip);
+  end_op();
+}
 
+// Replace p's user image with the program at path, run with
+// arguments argv. p is the current process, or a new one that
+// spawn() is setting up, which has no image yet and isn't
+// running. Returns argc for a0, or -1 leaving p as it was.
 int
-exec(char *path, char **argv)
+exec(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -18,8 +31,10 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+  pagetable_t pagetable = 0;
+  struct mm *mm = 0, *oldmm;
+  struct vma segs[NVMA], *v;
+  int nseg = 0;
 
   begin_op();
 
@@ -35,10 +50,13 @@ exec(char *path, char **argv)
   if(elf.magic != ELF_MAGIC)
     goto bad;
 
-  if((pagetable = proc_pagetable(p)) == 0)
+  if((mm = mmalloc(p)) == 0)
     goto bad;
+  pagetable = mm->pagetable;
 
-  // Load program into memory.
+  // Map the program's segments. Nothing is read yet:
+  // uvmfault() reads each page from ip when it is first
+  // touched.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -48,22 +66,30 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz >= USERTOP)
       goto bad;
-    sz = sz1;
     if((ph.vaddr % PGSIZE) != 0)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.off + ph.filesz < ph.off)
+      goto bad;
+    if(nseg >= NVMA)
       goto bad;
+    v = &segs[nseg++];
+    memset(v, 0, sizeof(*v));
+    v->type = VMA_EXEC;
+    v->start = ph.vaddr;
+    v->end = PGROUNDUP(ph.vaddr + ph.memsz);
+    v->off = ph.off;
+    v->filesz = ph.filesz;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
+  for(i = 0; i < nseg; i++)
+    segs[i].ip = idup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
 
-  p = myproc();
-  uint64 oldsz = p->sz;
-
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
@@ -108,47 +134,33 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
-  // Commit to the user image.
-  oldpagetable = p->pagetable;
+  // Commit to the user image. Other threads keep the old
+  // one; the last to let go of it writes back its mmaps.
+  for(i = 0; i < nseg; i++)
+    mm->vma[i] = segs[i];
+  mm->sz = sz;
+  acquire(&p->lock);
+  oldmm = p->mm;
+  p->mm = mm;
   p->pagetable = pagetable;
-  p->sz = sz;
+  release(&p->lock);
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  if(oldmm)
+    mmput(oldmm, p);
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
-  if(pagetable)
-    proc_freepagetable(pagetable, sz);
+  if(mm){
+    mm->sz = sz;
+    mmput(mm, p);
+  }
   if(ip){
     iunlockput(ip);
     end_op();
+  } else {
+    putsegs(segs, nseg);
   }
   return -1;
 }
-
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-  
-  return 0;
-}
@@ -101,6 +101,27 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// How many of n bytes a read or write of f can move at once,
+// for uvmtouch(): no more than a pipe holds, or, for a file,
+// than is left of it. The file may change before it's locked,
+// so this is only a guide.
+static uint
+filespan(struct file *f, int n, int write)
+{
+  uint max;
+
+  if(n < 0)
+    return 0;
+  max = n;
+  if(f->type == FD_PIPE && !write)
+    max = PIPESIZE;
+  else if(f->type == FD_INODE && !write)
+    max = f->off < f->ip->size ? f->ip->size - f->off : 0;
+  else if(f->type == FD_INODE)
+    max = f->off < MAXFILE*BSIZE ? MAXFILE*BSIZE - f->off : 0;
+  return n < max ? n : max;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -111,6 +132,10 @@ fileread(struct file *f, uint64 addr, int n)
   if(f->readable == 0)
     return -1;
 
+  // pipes, devices and readi() copy out while holding locks,
+  // so load any file-backed pages of the buffer first.
+  uvmtouch(myproc(), addr, filespan(f, n, 0), 1);
+
   if(f->type == FD_PIPE){
     r = piperead(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
@@ -139,6 +164,8 @@ filewrite(struct file *f, uint64 addr, int n)
   if(f->writable == 0)
     return -1;
 
+  uvmtouch(myproc(), addr, filespan(f, n, 1), 0);
+
   if(f->type == FD_PIPE){
     ret = pipewrite(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
@@ -9,6 +9,8 @@ struct file {
   short major;       // FD_DEVICE
 };
 
+#define PIPESIZE 512  // bytes a pipe holds
+
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
 #define minor(dev)  ((dev) & 0xFFFF)
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
@@ -20,6 +22,8 @@ struct inode {
   int ref;            // Reference count
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint version;       // changes with the contents (see imginval())
+  int imgcached;      // the image cache may hold pages of it
 
   short type;         // copy of disk inode
   short major;
@@ -38,3 +42,4 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define STATS   2
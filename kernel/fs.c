@@ -307,6 +307,9 @@ ilock(struct inode *ip)
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
     ip->valid = 1;
+    // the image cache may still hold pages of it from
+    // before it last left the table.
+    ip->imgcached = 1;
     if(ip->type == 0)
       panic("ilock: no type");
   }
@@ -433,6 +436,7 @@ itrunc(struct inode *ip)
   }
 
   ip->size = 0;
+  imginval(ip);
   iupdate(ip);
 }
 
@@ -507,6 +511,8 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 
   if(off > ip->size)
     ip->size = off;
+  if(tot > 0)
+    imginval(ip);
 
   // write the i-node back to disk even if the size didn't change
   // because the loop above might have called bmap() and added a new
@@ -633,7 +639,7 @@ namex(char *path, int nameiparent, char *name)
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = cwd();
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
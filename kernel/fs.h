@@ -8,6 +8,7 @@
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
 //                                          free bit map | data blocks]
+// followed by the swap area, which isn't part of the file system.
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -20,6 +21,8 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint swapstart;    // Block number of first swap block, past the file system
+  uint nswap;        // Number of swap blocks
 };
 
 #define FSMAGIC 0x10203040
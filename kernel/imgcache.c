@@ -0,0 +1,239 @@
+// Image cache: pages of program files, shared copy-on-write
+// by every process that runs them, and the pages of MAP_SHARED
+// file mappings, which every process mapping them stores to.
+//
+// exec() maps a program's segments to be read in on first
+// touch (see uvmfault() in vm.c). A page read from the file is
+// kept here, keyed by the file's (dev, inum) and the offset
+// and length that were read, so that the next process to fault
+// on the same page maps this copy instead of reading the file
+// again, even once the inode has left the inode table. Writing
+// or truncating a file drops its pages (see imginval()).
+//
+// A page of a MAP_SHARED mapping is kept apart from those, as
+// it is written in place: it holds the file's contents as the
+// processes mapping it see them, until munmap() writes it back.
+// It stays while any process maps it, even if the file is
+// written, so that they all keep the same page; a write() to
+// that part of the file isn't seen by the mapping then.
+//
+// The cache holds one reference to each of its pages (see
+// kdup()); when it is full, the least recently used page is
+// dropped, which frees it once no process maps it.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+
+#define NIMGPAGE  512
+#define NIMGHASH  61
+
+struct imgpage {
+  uint dev;
+  uint inum;
+  uint off;                     // file offset of the page's first byte
+  uint n;                       // bytes from the file; the rest are zero
+  int shared;                   // a MAP_SHARED page, written in place
+  void *pa;                     // 0 if this entry is unused
+  struct imgpage *hnext;        // hash chain
+  struct imgpage *prev;         // LRU list
+  struct imgpage *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct imgpage page[NIMGPAGE];
+  struct imgpage *hash[NIMGHASH];
+
+  // Linked list of all pages, through prev/next.
+  // head.next is most recently used.
+  struct imgpage head;
+
+  uint hits;
+  uint misses;
+  int npage;
+} img;
+
+#define IMGHASH(dev, inum, off)  (((dev) * 31 + (inum) * 17 + ((off) >> PGSHIFT)) % NIMGHASH)
+
+void
+imginit(void)
+{
+  struct imgpage *e;
+
+  initlock(&img.lock, "imgcache");
+  img.head.prev = &img.head;
+  img.head.next = &img.head;
+  for(e = img.page; e < img.page+NIMGPAGE; e++){
+    e->next = img.head.next;
+    e->prev = &img.head;
+    img.head.next->prev = e;
+    img.head.next = e;
+  }
+}
+
+// Move e to the front of the LRU list.
+// Caller must hold img.lock.
+static void
+touch(struct imgpage *e)
+{
+  e->next->prev = e->prev;
+  e->prev->next = e->next;
+  e->next = img.head.next;
+  e->prev = &img.head;
+  img.head.next->prev = e;
+  img.head.next = e;
+}
+
+// Caller must hold img.lock.
+static struct imgpage *
+lookup(struct inode *ip, uint off, uint n, int shared)
+{
+  struct imgpage *e;
+
+  for(e = img.hash[IMGHASH(ip->dev, ip->inum, off)]; e; e = e->hnext)
+    if(e->dev == ip->dev && e->inum == ip->inum && e->off == off && e->n == n &&
+       e->shared == shared)
+      return e;
+  return 0;
+}
+
+// Is e a MAP_SHARED page that some process still maps?
+// Caller must hold img.lock.
+static int
+mapped(struct imgpage *e)
+{
+  return e->shared && krefcnt(e->pa) > 1;
+}
+
+// Take e out of the cache, dropping the cache's reference
+// to its page. Caller must hold img.lock.
+static void
+evict(struct imgpage *e)
+{
+  struct imgpage **pp;
+
+  for(pp = &img.hash[IMGHASH(e->dev, e->inum, e->off)]; *pp != e; pp = &(*pp)->hnext)
+    ;
+  *pp = e->hnext;
+  kfree(e->pa);
+  e->pa = 0;
+  img.npage--;
+}
+
+// Look for the page holding n bytes of ip at off. Returns it
+// with a reference for the caller, who must map it
+// copy-on-write unless shared is set, or 0 if it isn't cached.
+void *
+imgget(struct inode *ip, uint off, uint n, int shared)
+{
+  struct imgpage *e;
+  void *pa = 0;
+
+  acquire(&img.lock);
+  if((e = lookup(ip, off, n, shared)) != 0){
+    touch(e);
+    kdup(e->pa);
+    pa = e->pa;
+    img.hits++;
+  } else {
+    img.misses++;
+  }
+  release(&img.lock);
+  return pa;
+}
+
+// Offer pa, a page the caller just read from ip when
+// ip->version was version, to the cache. Returns the cached
+// page for the caller to map as imgget() says: pa itself, or,
+// if another process cached the same page first, that one, in
+// which case pa is freed. A page of a file written since it
+// was read isn't cached; if it was to be shared, pa is freed
+// and 0 returned, for the caller to read it again. Nor is one
+// cached if every page is mapped shared.
+void *
+imgput(struct inode *ip, uint version, uint off, uint n, void *pa, int shared)
+{
+  struct imgpage *e;
+  void *cached;
+  uint h;
+
+  acquire(&img.lock);
+  if((e = lookup(ip, off, n, shared)) != 0){
+    touch(e);
+    kdup(e->pa);
+    cached = e->pa;
+    release(&img.lock);
+    kfree(pa);
+    return cached;
+  }
+  if(ip->version != version){
+    release(&img.lock);
+    if(shared){
+      kfree(pa);
+      return 0;
+    }
+    return pa;
+  }
+
+  for(e = img.head.prev; e != &img.head && e->pa && mapped(e); e = e->prev)
+    ;
+  if(e == &img.head){
+    release(&img.lock);
+    return pa;
+  }
+  if(e->pa)
+    evict(e);
+  e->dev = ip->dev;
+  e->inum = ip->inum;
+  e->off = off;
+  e->n = n;
+  e->shared = shared;
+  e->pa = pa;
+  kdup(pa);
+  h = IMGHASH(e->dev, e->inum, e->off);
+  e->hnext = img.hash[h];
+  img.hash[h] = e;
+  img.npage++;
+  touch(e);
+  ip->imgcached = 1;
+  release(&img.lock);
+  return pa;
+}
+
+// ip's contents are changing: drop its cached pages, but for
+// MAP_SHARED ones still mapped, and stop a read already under
+// way from caching what it read. The caller holds ip's lock.
+void
+imginval(struct inode *ip)
+{
+  struct imgpage *e;
+  int kept = 0;
+
+  acquire(&img.lock);
+  ip->version++;
+  if(ip->imgcached){
+    for(e = img.page; e < img.page+NIMGPAGE; e++){
+      if(e->pa == 0 || e->dev != ip->dev || e->inum != ip->inum)
+        continue;
+      if(mapped(e))
+        kept = 1;
+      else
+        evict(e);
+    }
+    ip->imgcached = kept;
+  }
+  release(&img.lock);
+}
+
+int
+statsimg(char *buf, int sz)
+{
+  return snprintf(buf, sz, "--- image cache: pages %d hits %d misses %d\n",
+                  img.npage, img.hits, img.misses);
+}
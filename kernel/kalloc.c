@@ -1,6 +1,28 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers.
+//
+// Memory is managed by a binary buddy allocator: a free block
+// of order k is 2^k contiguous pages aligned to its size, and
+// freeing a block merges it with its buddy whenever the buddy
+// is also free. kalloc_pages()/kfree_pages() hand out blocks
+// of any order up to MAXORDER.
+//
+// Single pages (kalloc()/kfree()) are the common case, so each
+// CPU keeps its own cache of order-0 pages with its own lock.
+// An empty cache is refilled from the buddy lists in a batch;
+// if those are empty too, the CPU steals a batch of pages from
+// another CPU's cache.
+//
+// Pages from kalloc() are reference counted so that fork can
+// share them copy-on-write: kalloc() sets the count to one,
+// kdup() adds a reference, and kfree() drops one, freeing the
+// page when the last reference goes. A superpage from
+// ksuperalloc() is 2^SUPERORDER such pages, each counted on its
+// own, so that it can be split into single pages at any time.
+//
+// Building with KALLOC_DEBUG=1 fills pages with junk on every
+// kalloc and kfree, to catch uses of uninitialized or freed memory.
 
 #include "types.h"
 #include "param.h"
@@ -9,57 +31,367 @@
 #include "riscv.h"
 #include "defs.h"
 
+#define BATCH      32          // pages moved between a CPU cache and the buddy lists
+#define CACHEHIGH  (2*BATCH)   // a CPU cache holding more gives BATCH back
+#define NPAGE      ((PHYSTOP - KERNBASE) / PGSIZE)
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// free pages are linked through their first bytes.
 struct run {
   struct run *next;
+  struct run *prev;  // buddy lists only
 };
 
-struct {
+// per-CPU cache of free single pages.
+struct kmem {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;     // pages on freelist
+  uint nsteal;   // batches this CPU stole from others
+};
+
+static struct kmem kmem[NCPU];
+
+static char kmemnames[NCPU][8];
+
+// one entry per physical page, indexed by PA2PG().
+struct page {
+  uchar free;    // first page of a free block on a buddy list
+  uchar order;   // order of that block
+  int ref;       // references to a page from kalloc()
+};
+
+static struct {
+  struct spinlock lock;
+  struct run *free[MAXORDER+1];  // doubly linked, by order
+  int nfree[MAXORDER+1];         // blocks on each list
+  struct page pages[NPAGE];
+} buddy;
+
+#define PA2PG(pa)  (((uint64)(pa) - KERNBASE) >> PGSHIFT)
+#define PG2PA(pg)  (KERNBASE + ((uint64)(pg) << PGSHIFT))
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  for(int i = 0; i < NCPU; i++){
+    snprintf(kmemnames[i], sizeof(kmemnames[i]), "kmem%d", i);
+    initlock(&kmem[i].lock, kmemnames[i]);
+  }
+  initlock(&buddy.lock, "kmem_buddy");
   freerange(end, (void*)PHYSTOP);
 }
 
+static void
+buddy_push(struct run *r, int order)
+{
+  struct page *pg = &buddy.pages[PA2PG(r)];
+
+  pg->free = 1;
+  pg->order = order;
+  r->prev = 0;
+  r->next = buddy.free[order];
+  if(r->next)
+    r->next->prev = r;
+  buddy.free[order] = r;
+  buddy.nfree[order]++;
+}
+
+static void
+buddy_remove(struct run *r, int order)
+{
+  buddy.pages[PA2PG(r)].free = 0;
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    buddy.free[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  buddy.nfree[order]--;
+}
+
+// Allocate a block of 2^order pages from the buddy lists,
+// splitting a larger block if needed.
+// Caller must hold buddy.lock.
+static struct run *
+buddy_alloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k <= MAXORDER; k++)
+    if(buddy.free[k])
+      break;
+  if(k > MAXORDER)
+    return 0;
+
+  r = buddy.free[k];
+  buddy_remove(r, k);
+  // give back the upper half until the block is the right size.
+  while(k > order){
+    k--;
+    buddy_push((struct run*)((char*)r + (PGSIZE << k)), k);
+  }
+  return r;
+}
+
+// Return a block of 2^order pages to the buddy lists,
+// merging it with its buddy as long as the buddy is free.
+// Caller must hold buddy.lock.
+static void
+buddy_free(void *pa, int order)
+{
+  uint64 pg = PA2PG(pa);
+  uint64 bpg;
+
+  while(order < MAXORDER){
+    bpg = pg ^ (1L << order);
+    if(bpg + (1L << order) > NPAGE)
+      break;
+    if(!buddy.pages[bpg].free || buddy.pages[bpg].order != order)
+      break;
+    buddy_remove((struct run*)PG2PA(bpg), order);
+    pg &= ~(1L << order);
+    order++;
+  }
+  buddy_push((struct run*)PG2PA(pg), order);
+}
+
+// Hand every free page to the buddy allocator, as the
+// largest aligned blocks that fit.
 void
 freerange(void *pa_start, void *pa_end)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  uint64 p = PGROUNDUP((uint64)pa_start);
+  int order;
+
+  while(p + PGSIZE <= (uint64)pa_end){
+    order = 0;
+    while(order < MAXORDER &&
+          (PA2PG(p) & ((2L << order) - 1)) == 0 &&
+          p + (PGSIZE << (order+1)) <= (uint64)pa_end)
+      order++;
+    kfree_pages((void*)p, order);
+    p += PGSIZE << order;
+  }
+}
+
+static void
+checkpa(void *pa, int order, char *s)
+{
+  if(order < 0 || order > MAXORDER)
+    panic(s);
+  if(((uint64)pa % (PGSIZE << order)) != 0 || (char*)pa < end ||
+     (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic(s);
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size. Returns 0 if no such block is free.
+void *
+kalloc_pages(int order)
+{
+  struct run *r;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
+
+  acquire(&buddy.lock);
+  r = buddy_alloc(order);
+  release(&buddy.lock);
+
+  if(r == 0 && order > 0){
+    // free pages sitting in CPU caches may be
+    // what stops blocks from merging.
+    kmem_drain();
+    acquire(&buddy.lock);
+    r = buddy_alloc(order);
+    release(&buddy.lock);
+  }
+
+#ifdef KALLOC_DEBUG
+  if(r)
+    memset((char*)r, 5, PGSIZE << order); // fill with junk
+#endif
+  return (void*)r;
+}
+
+// Free a block returned by kalloc_pages(order).
+void
+kfree_pages(void *pa, int order)
+{
+  checkpa(pa, order, "kfree_pages");
+
+#ifdef KALLOC_DEBUG
+  // Fill with junk to catch dangling refs.
+  memset(pa, 1, PGSIZE << order);
+#endif
+
+  acquire(&buddy.lock);
+  buddy_free(pa, order);
+  release(&buddy.lock);
+}
+
+// Give up to n pages from the head of CPU cache km back
+// to the buddy lists.
+static void
+kmem_release(struct kmem *km, int n)
+{
+  struct run *head, *r;
+
+  acquire(&km->lock);
+  head = km->freelist;
+  for(r = head; r && n > 1; n--)
+    r = r->next;
+  if(r){
+    km->freelist = r->next;
+    r->next = 0;
+  } else {
+    km->freelist = 0;
+  }
+  for(r = head; r; r = r->next)
+    km->nfree--;
+  release(&km->lock);
+
+  acquire(&buddy.lock);
+  while(head){
+    r = head;
+    head = head->next;
+    buddy_free(r, 0);
+  }
+  release(&buddy.lock);
+}
+
+// Return every page in every CPU cache to the buddy lists.
+void
+kmem_drain(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    kmem_release(&kmem[i], NPAGE);
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by pa, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last one.
 void
 kfree(void *pa)
 {
   struct run *r;
+  struct kmem *km;
+  int full, ref;
 
-  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
-    panic("kfree");
+  checkpa(pa, 0, "kfree");
 
+  ref = __sync_sub_and_fetch(&buddy.pages[PA2PG(pa)].ref, 1);
+  if(ref > 0)
+    return;
+  if(ref < 0)
+    panic("kfree: ref");
+
+#ifdef KALLOC_DEBUG
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  km = &kmem[cpuid()];
+  acquire(&km->lock);
+  r->next = km->freelist;
+  km->freelist = r;
+  km->nfree++;
+  full = km->nfree > CACHEHIGH;
+  release(&km->lock);
+  if(full)
+    kmem_release(km, BATCH);
+  pop_off();
+}
+
+// Move up to BATCH pages from the buddy lists into CPU id's
+// cache, and return one of them, or 0 if the lists are empty.
+// Interrupts must be disabled.
+static struct run *
+refill(int id)
+{
+  struct run *head = 0, *r;
+  int n;
+
+  acquire(&buddy.lock);
+  for(n = 0; n < BATCH; n++){
+    if((r = buddy_alloc(0)) == 0)
+      break;
+    r->next = head;
+    head = r;
+  }
+  release(&buddy.lock);
+
+  if(head == 0)
+    return 0;
+
+  r = head;
+  if(n > 1){
+    struct run *tail = head->next;
+    while(tail->next)
+      tail = tail->next;
+    acquire(&kmem[id].lock);
+    tail->next = kmem[id].freelist;
+    kmem[id].freelist = head->next;
+    kmem[id].nfree += n - 1;
+    release(&kmem[id].lock);
+  }
+  return r;
+}
+
+// Move up to half of another CPU's free pages
+// (at most BATCH) onto CPU id's list, and
+// return one of them, or 0 if every list is empty.
+// Only one lock is held at a time, so two CPUs
+// stealing from each other cannot deadlock.
+// Interrupts must be disabled.
+static struct run *
+steal(int id)
+{
+  struct run *head, *tail, *r;
+  struct kmem *victim;
+  int i, n, take;
+
+  for(i = 1; i < NCPU; i++){
+    victim = &kmem[(id + i) % NCPU];
+    acquire(&victim->lock);
+    take = (victim->nfree + 1) / 2;
+    if(take > BATCH)
+      take = BATCH;
+    head = tail = victim->freelist;
+    for(n = 1; n < take; n++)
+      tail = tail->next;
+    if(take > 0){
+      victim->freelist = tail->next;
+      victim->nfree -= take;
+    }
+    release(&victim->lock);
+
+    if(take == 0)
+      continue;
+
+    // keep the first page for the caller, and
+    // put the rest on this CPU's list.
+    r = head;
+    acquire(&kmem[id].lock);
+    if(take > 1){
+      tail->next = kmem[id].freelist;
+      kmem[id].freelist = head->next;
+      kmem[id].nfree += take - 1;
+    }
+    kmem[id].nsteal++;
+    release(&kmem[id].lock);
+    return r;
+  }
+  return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +401,146 @@ void *
 kalloc(void)
 {
   struct run *r;
+  struct kmem *km;
+  int id;
+
+  push_off();
+  id = cpuid();
+  km = &kmem[id];
+  acquire(&km->lock);
+  r = km->freelist;
+  if(r){
+    km->freelist = r->next;
+    km->nfree--;
+  }
+  release(&km->lock);
+
+  if(r == 0)
+    r = refill(id);
+  if(r == 0)
+    r = steal(id);
+  pop_off();
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
   if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+    buddy.pages[PA2PG(r)].ref = 1;
 
+#ifdef KALLOC_DEBUG
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
   return (void*)r;
 }
+
+// Add a reference to a page returned by kalloc().
+void
+kdup(void *pa)
+{
+  checkpa(pa, 0, "kdup");
+  if(__sync_fetch_and_add(&buddy.pages[PA2PG(pa)].ref, 1) < 1)
+    panic("kdup: free page");
+}
+
+// How many references are there to a page from kalloc()?
+int
+krefcnt(void *pa)
+{
+  return buddy.pages[PA2PG(pa)].ref;
+}
+
+// Allocate a superpage: SUPERPGSIZE bytes, aligned to their
+// size, each of its pages with one reference as from kalloc().
+// Returns 0 if there is no free block that big; the caller
+// can fall back to single pages, so this doesn't drain the
+// CPU caches to make one.
+void *
+ksuperalloc(void)
+{
+  struct run *r;
+  uint64 pg;
+
+  acquire(&buddy.lock);
+  r = buddy_alloc(SUPERORDER);
+  release(&buddy.lock);
+  if(r == 0)
+    return 0;
+
+  for(pg = PA2PG(r); pg < PA2PG(r) + (1L << SUPERORDER); pg++)
+    buddy.pages[pg].ref = 1;
+#ifdef KALLOC_DEBUG
+  memset((char*)r, 5, SUPERPGSIZE); // fill with junk
+#endif
+  return (void*)r;
+}
+
+// Add a reference to each page of a superpage.
+void
+ksuperdup(void *pa)
+{
+  for(int i = 0; i < (1L << SUPERORDER); i++)
+    kdup((char*)pa + i*PGSIZE);
+}
+
+// The most references to any page of a superpage.
+int
+ksuperrefcnt(void *pa)
+{
+  uint64 pg;
+  int ref = 0;
+
+  for(pg = PA2PG(pa); pg < PA2PG(pa) + (1L << SUPERORDER); pg++)
+    if(buddy.pages[pg].ref > ref)
+      ref = buddy.pages[pg].ref;
+  return ref;
+}
+
+// Drop a reference to each page of a superpage. If the caller
+// held the only ones, the block goes back to the buddy lists
+// whole; otherwise each page is freed when its last goes.
+void
+ksuperfree(void *pa)
+{
+  uint64 pg;
+
+  checkpa(pa, SUPERORDER, "ksuperfree");
+  if(ksuperrefcnt(pa) == 1){
+    for(pg = PA2PG(pa); pg < PA2PG(pa) + (1L << SUPERORDER); pg++)
+      buddy.pages[pg].ref = 0;
+    kfree_pages(pa, SUPERORDER);
+    return;
+  }
+  for(int i = 0; i < (1L << SUPERORDER); i++)
+    kfree((char*)pa + i*PGSIZE);
+}
+
+// Allocate one page of physical memory, filled with zeros.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  char *pa;
+
+  if((pa = kalloc()) != 0)
+    memset(pa, 0, PGSIZE);
+  return pa;
+}
+
+// Report per-CPU cache sizes and steals, and the
+// number of free buddy blocks of each order, into buf.
+int
+statskmem(char *buf, int sz)
+{
+  int n, i;
+
+  n = snprintf(buf, sz, "--- kalloc per-cpu free lists\n");
+  for(i = 0; i < NCPU; i++){
+    if(kmem[i].nfree == 0 && kmem[i].nsteal == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "cpu %d: free %d steals %d\n",
+                  i, kmem[i].nfree, kmem[i].nsteal);
+  }
+  n += snprintf(buf+n, sz-n, "--- buddy free blocks by order\n");
+  for(i = 0; i <= MAXORDER; i++)
+    n += snprintf(buf+n, sz-n, "%d:%d ", i, buddy.nfree[i]);
+  n += snprintf(buf+n, sz-n, "\n");
+  return n;
+}
@@ -0,0 +1,160 @@
+// Same-page merging: while a hart has nothing to run, look
+// through the read-only pages of processes that aren't
+// running for pages with the same contents, and map them
+// all to one copy, copy-on-write where they are writable,
+// freeing the rest. Copies of a program that the image cache
+// no longer holds, and data that forked children have copied
+// but not changed, end up sharing memory again.
+//
+// Pages seen so far are remembered by checksum in a table
+// that holds a reference to each (see kdup()), so that a
+// later page with the same checksum can be compared with it.
+//
+// scheduler() calls ksmscan() only in kernels built with
+// KSM=1.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fcntl.h"
+#include "defs.h"
+
+#define NKSM     256   // pages remembered
+#define KSMSCAN  32    // pages ksmscan() looks at per call
+
+extern struct proc proc[NPROC];
+
+static struct {
+  struct spinlock lock;
+  uint sum[NKSM];
+  void *pa[NKSM];
+  int hand;       // process being scanned
+  uint64 va;      // and where in it
+  int next;       // table entry to check next
+  uint scanned;
+  uint merged;
+} ksm;
+
+void
+ksminit(void)
+{
+  initlock(&ksm.lock, "ksm");
+}
+
+static uint
+checksum(uint64 *w)
+{
+  uint64 h = 0;
+  int i;
+
+  for(i = 0; i < PGSIZE/sizeof(uint64); i++)
+    h = h * 31 + w[i];
+  return h ^ (h >> 32);
+}
+
+// Map the page at *pte to a page with the same contents seen
+// before, if there is one, or else remember it.
+// Returns 1 if *pte changed. Caller holds ksm.lock.
+static int
+merge(pte_t *pte)
+{
+  void *pa = (void*)PTE2PA(*pte);
+  uint sum = checksum(pa);
+  int i = sum % NKSM;
+
+  if(ksm.pa[i] == pa)
+    return 0;
+  if(ksm.pa[i] && ksm.sum[i] == sum && memcmp(ksm.pa[i], pa, PGSIZE) == 0){
+    kdup(ksm.pa[i]);
+    *pte = PA2PTE(ksm.pa[i]) | PTE_FLAGS(*pte);
+    kfree(pa);
+    ksm.merged++;
+    return 1;
+  }
+  if(ksm.pa[i])
+    kfree(ksm.pa[i]);
+  kdup(pa);
+  ksm.pa[i] = pa;
+  ksm.sum[i] = sum;
+  return 0;
+}
+
+// Look at up to n more pages of p, which isn't running and
+// has its address space to itself. Returns -1 once there
+// are none left, or else how many it looked at.
+// Caller holds ksm.lock and p->lock.
+static int
+ksmproc(struct proc *p, int n)
+{
+  struct mm *mm = p->mm;
+  struct vma *v;
+  pte_t *pte;
+  uint64 va;
+  int i, changed = 0;
+
+  acquire(&mm->lock);
+  for(i = 0; i < n; i++){
+    if((pte = uvmnext(p->pagetable, &ksm.va)) == 0)
+      break;
+    va = ksm.va;
+    ksm.va += PGSIZE;
+    ksm.scanned++;
+    // writes to a MAP_SHARED mmap must stay shared, and
+    // munmap() may be writing back a VMA_UNMAP's pages.
+    if((*pte & PTE_W) ||
+       ((v = vmalookup(p, va)) != 0 &&
+        ((v->type == VMA_MMAP && (v->flags & MAP_SHARED)) || v->type == VMA_UNMAP)))
+      continue;
+    changed |= merge(pte);
+  }
+  if(changed)
+    mm->tlbcpus = 0;  // flush before it next runs
+  release(&mm->lock);
+  return i < n ? -1 : i;
+}
+
+// Called by scheduler(), holding no locks, when it has
+// found nothing to run.
+void
+ksmscan(void)
+{
+  struct proc *p;
+  int k, n = 0, r;
+
+  acquire(&ksm.lock);
+  // forget a few pages that no process maps any more.
+  for(k = 0; k < KSMSCAN; k++){
+    if(ksm.pa[ksm.next] && krefcnt(ksm.pa[ksm.next]) == 1){
+      kfree(ksm.pa[ksm.next]);
+      ksm.pa[ksm.next] = 0;
+    }
+    ksm.next = (ksm.next + 1) % NKSM;
+  }
+
+  for(k = 0; k < NPROC && n < KSMSCAN; k++){
+    p = &proc[ksm.hand];
+    acquire(&p->lock);
+    r = -1;
+    if(p->pagetable && p->mm->ref == 1 &&
+       (p->state == RUNNABLE || p->state == SLEEPING))
+      r = ksmproc(p, KSMSCAN - n);
+    release(&p->lock);
+    if(r < 0){
+      ksm.hand = (ksm.hand + 1) % NPROC;
+      ksm.va = 0;
+    } else {
+      n += r;
+    }
+  }
+  release(&ksm.lock);
+}
+
+int
+statsksm(char *buf, int sz)
+{
+  return snprintf(buf, sz, "--- same-page merging: scanned %d merged %d\n",
+                  ksm.scanned, ksm.merged);
+}
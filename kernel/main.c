@@ -17,16 +17,23 @@ main()
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
+    slabinit();      // small-object caches
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    timerwheelinit(); // timeouts
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
+    imginit();       // image cache
+    swapinit();      // swap area
+    ksminit();       // same-page merging
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    statsinit();     // statistics device
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
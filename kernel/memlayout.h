@@ -62,6 +62,10 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
-//   TRAPFRAME (p->trapframe, used by the trampoline)
+//   USERTOP
+//   TRAPFRAME(i) (proc[i].trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
-#define TRAPFRAME (TRAMPOLINE - PGSIZE)
+// Threads share a page table, so each proc[] slot has a
+// trapframe address of its own.
+#define TRAPFRAME(i) (TRAMPOLINE - ((i)+1)*PGSIZE)
+#define USERTOP TRAPFRAME(NPROC-1)
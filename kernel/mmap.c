@@ -0,0 +1,319 @@
+//
+// Per-process memory regions: the segments exec maps,
+// and mmap()ed files and anonymous memory.
+//
+// Pages of a region are filled in on first touch by
+// uvmfault() in vm.c, but for shared anonymous memory, which
+// mmap() fills in at once. mmaps live at the top of the user
+// address space, below the trapframes, and the heap may not
+// grow into them. The pages of a MAP_SHARED file mapping come
+// from the image cache, one for each page of the file, which
+// every process that maps it there stores to. Dirty ones are
+// written back to the file by munmap(), and by exit() and
+// exec() in the last thread to let go of the address space.
+//
+// The regions belong to p->mm, whose lock guards them. A
+// fault reads them without it, and checks again before
+// mapping the page (see uvmfault()).
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+
+// Find the region of p that contains va.
+struct vma *
+vmalookup(struct proc *p, uint64 va)
+{
+  struct mm *mm = p->mm;
+  struct vma *v;
+
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(v->type != VMA_NONE && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// The heap may grow up to here: the lowest mmap,
+// or else the trapframes. Caller holds p->mm->lock.
+uint64
+vmalimit(struct proc *p)
+{
+  struct mm *mm = p->mm;
+  struct vma *v;
+  uint64 limit = USERTOP;
+
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if((v->type == VMA_MMAP || v->type == VMA_UNMAP) && v->start < limit)
+      limit = v->start;
+  return limit;
+}
+
+static struct vma *
+vmaalloc(struct mm *mm)
+{
+  struct vma *v;
+
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(v->type == VMA_NONE)
+      return v;
+  return 0;
+}
+
+// Find the highest free n bytes between the heap and the
+// trapframes. Returns 0 if there is no room.
+static uint64
+vmaplace(struct mm *mm, uint64 n)
+{
+  struct vma *v, *w;
+  uint64 top, start, best = 0;
+
+  for(v = mm->vma; v <= &mm->vma[NVMA]; v++){
+    // try just below the trapframes, and just below each region.
+    if(v == &mm->vma[NVMA])
+      top = USERTOP;
+    else if(v->type != VMA_NONE)
+      top = v->start;
+    else
+      continue;
+    if(top < n || (start = top - n) < PGROUNDUP(mm->sz) || start <= best)
+      continue;
+    for(w = mm->vma; w < &mm->vma[NVMA]; w++)
+      if(w->type != VMA_NONE && start < w->end && top > w->start)
+        break;
+    if(w == &mm->vma[NVMA])
+      best = start;
+  }
+  return best;
+}
+
+// Map len bytes of f from offset off, or of zeros if f is 0,
+// into the current process. Returns the address, or -1.
+// Shared anonymous memory is allocated now: there is nothing
+// else for the processes that fork() shares it with to meet on
+// (see vmadup()).
+uint64
+mmap(uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct mm *mm = p->mm;
+  struct vma *v;
+  uint64 start, va, n = PGROUNDUP(len);
+
+  if(len == 0 || n < len)
+    return -1;
+  acquire(&mm->lock);
+  if((v = vmaalloc(mm)) == 0 || (start = vmaplace(mm, n)) == 0){
+    release(&mm->lock);
+    return -1;
+  }
+
+  v->type = VMA_MMAP;
+  v->start = start;
+  v->end = start + n;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = f ? filedup(f) : 0;
+  v->ip = f ? f->ip : 0;
+  v->off = off;
+  v->filesz = f ? len : 0;
+  release(&mm->lock);
+
+  if(f == 0 && (flags & MAP_SHARED) && prot != PROT_NONE){
+    for(va = start; va < start + n; va += PGSIZE){
+      if(uvmfault(p, va, PTE_R) < 0){
+        munmap(start, n);
+        return -1;
+      }
+    }
+  }
+  return start;
+}
+
+// Write the page at va of shared file mapping v, whose
+// contents are at pa, back to the file. The file doesn't grow.
+static void
+vmawrite(struct vma *v, uint64 va, uint64 pa)
+{
+  struct inode *ip = v->ip;
+  uint off = v->off + (va - v->start);
+  uint n = PGSIZE;
+
+  // a page is at most 5 blocks, plus the inode and the
+  // indirect block: well within one transaction.
+  begin_op();
+  ilock(ip);
+  if(off < ip->size){
+    if(n > ip->size - off)
+      n = ip->size - off;
+    writei(ip, 0, pa, off, n);
+  }
+  iunlock(ip);
+  end_op();
+}
+
+// Unmap [start, end) of region v in mm, first writing dirty
+// pages of a shared file mapping back to the file: those
+// whose dirty bit the hardware has set, since the page was
+// mapped, in this process or, before it forked, its parent.
+static void
+vmaunmap(struct mm *mm, struct vma *v, uint64 start, uint64 end)
+{
+  uint64 va;
+  pte_t *pte;
+
+  if(v->f && (v->flags & MAP_SHARED)){
+    for(va = start; va < end; va += PGSIZE){
+      pte = walk(mm->pagetable, va, 0);
+      if(pte && (*pte & PTE_V) && (*pte & PTE_D))
+        vmawrite(v, va, PTE2PA(*pte));
+    }
+  }
+  uvmunmapsync(mm, start, (end - start) / PGSIZE);
+}
+
+// Remove the mappings of [addr, addr+len), which must lie
+// in a single mmap, from the current process.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct mm *mm = p->mm;
+  struct vma *v, *nv = 0, *hold, old;
+  uint64 end = PGROUNDUP(addr + len), shift;
+  int whole, hole;
+
+  if((addr % PGSIZE) != 0 || len == 0 || end <= addr)
+    return -1;
+  acquire(&mm->lock);
+  if((v = vmalookup(p, addr)) == 0 || v->type != VMA_MMAP || end > v->end){
+    release(&mm->lock);
+    return -1;
+  }
+  // the range stays taken until its pages are gone (see
+  // VMA_UNMAP).
+  hole = addr > v->start && end < v->end;
+  if((hold = vmaalloc(mm)) == 0){
+    release(&mm->lock);
+    return -1;
+  }
+  hold->type = VMA_UNMAP;
+  if(hole && (nv = vmaalloc(mm)) == 0){
+    hold->type = VMA_NONE;
+    release(&mm->lock);
+    return -1;
+  }
+
+  if(hole){
+    // punching a hole: the part above it becomes a region
+    // of its own.
+    *nv = *v;
+    shift = end - v->start;
+    nv->start = end;
+    nv->off += shift;
+    nv->filesz = v->filesz > shift ? v->filesz - shift : 0;
+    if(nv->f)
+      filedup(nv->f);
+    v->end = end;
+  }
+
+  // the region changes now, so that other threads fault on
+  // the pages once they are gone; they go below, since
+  // writing them back sleeps.
+  old = *v;
+  whole = addr == v->start && end == v->end;
+  if(whole){
+    memset(v, 0, sizeof(*v));
+  } else if(addr == v->start){
+    shift = end - v->start;
+    v->start = end;
+    v->off += shift;
+    v->filesz = v->filesz > shift ? v->filesz - shift : 0;
+  } else {
+    v->end = addr;
+  }
+  hold->start = addr;
+  hold->end = end;
+  release(&mm->lock);
+
+  vmaunmap(mm, &old, addr, end);
+  acquire(&mm->lock);
+  memset(hold, 0, sizeof(*hold));
+  release(&mm->lock);
+  if(whole && old.f)
+    fileclose(old.f);
+  return 0;
+}
+
+// Give np, a new child of p, p's regions. Pages of MAP_SHARED
+// mmaps that p has mapped stay shared between them; the child
+// faults in the rest of a file's from the image cache, as p
+// does (see vmaload() in vm.c). The rest become copy-on-write
+// like the rest of memory (see uvmcopy()). Called with np->lock
+// and p->mm->lock held, so it must not sleep.
+// Returns 0 on success, -1 on failure.
+int
+vmadup(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->mm->vma[i];
+    if(v->type == VMA_MMAP &&
+       uvmcopyrange(p->pagetable, np->pagetable, v->start, v->end,
+                    v->flags & MAP_SHARED) < 0)
+      goto err;
+  }
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->mm->vma[i];
+    if(v->type == VMA_UNMAP)
+      continue;  // the child doesn't get those pages
+    np->mm->vma[i] = *v;
+    if(v->type == VMA_EXEC)
+      idup(v->ip);
+    else if(v->type == VMA_MMAP && v->f)
+      filedup(v->f);
+  }
+  return 0;
+
+ err:
+  while(--i >= 0){
+    v = &p->mm->vma[i];
+    if(v->type == VMA_MMAP)
+      uvmunmap(np->pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+  }
+  return -1;
+}
+
+// Release all of mm's regions, once no thread uses it: write
+// back and unmap its mmaps, and let go of the files of its
+// exec segments, whose pages lie below mm->sz and are freed
+// along with the page table.
+void
+vmaclear(struct mm *mm)
+{
+  struct vma *v;
+
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++){
+    if(v->type == VMA_MMAP){
+      vmaunmap(mm, v, v->start, v->end);
+      if(v->f)
+        fileclose(v->f);
+    } else if(v->type == VMA_EXEC){
+      begin_op();
+      iput(v->ip);
+      end_op();
+    }
+    memset(v, 0, sizeof(*v));
+  }
+}
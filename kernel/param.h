@@ -1,6 +1,11 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
+#define NPRIO         4  // scheduler priority levels
+#define BOOST        50  // ticks between scheduler priority boosts
+#define TICKCYCLES 1000000 // timer cycles per tick; about 1/10th second in qemu
 #define NOFILE       16  // open files per process
+#define NVMA         16  // exec segments and mmaps per process
+#define NCOWOLD       4  // copy-on-write pages a system call may copy under a spinlock
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
@@ -10,4 +15,6 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define SWAPSIZE     4096  // size of swap area, after the file system, in blocks
 #define MAXPATH      128   // maximum file path name
+#define MAXORDER     10    // largest buddy block is 2^MAXORDER pages
@@ -8,8 +8,6 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
-
 struct pipe {
   struct spinlock lock;
   char data[PIPESIZE];
@@ -19,6 +17,14 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+static struct kmem_cache *pipecache;
+
+void
+pipeinit(void)
+{
+  pipecache = kmem_cache_create("pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,7 +34,8 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)kmem_cache_alloc(pipecache)) == 0 &&
+     (reclaim() == 0 || (pi = (struct pipe*)kmem_cache_alloc(pipecache)) == 0))
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
@@ -47,7 +54,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    kmem_cache_free(pipecache, pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,7 +75,8 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    freelock(&pi->lock);
+    kmem_cache_free(pipecache, pi);
   } else
     release(&pi->lock);
 }
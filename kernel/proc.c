@@ -4,6 +4,9 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "rusage.h"
+#include "timer.h"
+#include "fcntl.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -20,12 +23,46 @@ static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
+static struct kmem_cache *mmcache;
+static struct kmem_cache *filescache;
+
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// see futex().
+static struct spinlock futex_lock;
+
+// Processes in sleep() wait on a queue chosen by hashing
+// the channel, so wakeup() need only look at those that
+// sleep on channels with the same hash, not at every
+// process. The newest is at the head.
+#define NWAITQ 61
+#define WAITQ(chan) (&waitq[((uint64)(chan) >> 3) % NWAITQ])
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+};
+
+static struct waitq waitq[NWAITQ];
+static void waitqremove(struct waitq *q, struct proc *p);
+
+// p->affinity has a bit for each cpu p may run on.
+#define ALLCPUS        ((1 << NCPU) - 1)
+#define ALLOWED(p, c)  ((p)->affinity & (1 << ((c) - cpus)))
+
+static char *states[] = {
+[UNUSED]    "unused",
+[USED]      "used  ",
+[SLEEPING]  "sleep ",
+[RUNNABLE]  "runble",
+[RUNNING]   "run   ",
+[ZOMBIE]    "zombie"
+};
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -47,13 +84,22 @@ void
 procinit(void)
 {
   struct proc *p;
+  struct cpu *c;
+  struct waitq *q;
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  initlock(&futex_lock, "futex");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
   }
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->rq.lock, "runq");
+  for(q = waitq; q < &waitq[NWAITQ]; q++)
+    initlock(&q->lock, "waitq");
+  mmcache = kmem_cache_create("mm", sizeof(struct mm));
+  filescache = kmem_cache_create("files", sizeof(struct files));
 }
 
 // Must be called with interrupts disabled,
@@ -119,6 +165,10 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->cpu = -1;
+  p->nice = p->prio = p->quantum = 0;
+  p->affinity = ALLCPUS;
+  p->nmigrate = 0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -127,14 +177,6 @@ found:
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
-    freeproc(p);
-    release(&p->lock);
-    return 0;
-  }
-
   // Set up new context to start executing at forkret,
   // which returns to user space.
   memset(&p->context, 0, sizeof(p->context));
@@ -145,18 +187,22 @@ found:
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
+// including user pages if p has an address space of its
+// own, which must not have regions that need writing back
+// (exit() has let go of a zombie's).
 // p->lock must be held.
 static void
 freeproc(struct proc *p)
 {
+  if(p->mm)
+    mmput(p->mm, p);
+  p->mm = 0;
+  p->pagetable = 0;
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
+  p->pinva = p->pinend = 0;
+  p->minflt = p->majflt = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -166,47 +212,160 @@ freeproc(struct proc *p)
   p->state = UNUSED;
 }
 
-// Create a user page table for a given process,
-// with no user memory, but with trampoline pages.
-pagetable_t
-proc_pagetable(struct proc *p)
+// Create an address space for p, with no user memory, but
+// with the trampoline page, and p's trapframe just below it
+// at TRAPFRAME(i) for proc[i].
+// Returns 0 if out of memory.
+struct mm *
+mmalloc(struct proc *p)
 {
-  pagetable_t pagetable;
+  struct mm *mm;
 
-  // An empty page table.
-  pagetable = uvmcreate();
-  if(pagetable == 0)
+  if((mm = kmem_cache_alloc(mmcache)) == 0)
     return 0;
+  memset(mm, 0, sizeof(*mm));
+  initlock(&mm->lock, "mm");
+
+  // An empty page table.
+  if((mm->pagetable = uvmcreate()) == 0)
+    goto bad;
 
   // map the trampoline code (for system call return)
   // at the highest user virtual address.
   // only the supervisor uses it, on the way
   // to/from user space, so not PTE_U.
-  if(mappages(pagetable, TRAMPOLINE, PGSIZE,
+  if(mappages(mm->pagetable, TRAMPOLINE, PGSIZE,
               (uint64)trampoline, PTE_R | PTE_X) < 0){
-    uvmfree(pagetable, 0);
-    return 0;
+    uvmfree(mm->pagetable, 0);
+    goto bad;
+  }
+
+  if(mmget(mm, p) < 0){
+    uvmunmap(mm->pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(mm->pagetable, 0);
+    goto bad;
+  }
+  return mm;
+
+ bad:
+  freelock(&mm->lock);
+  kmem_cache_free(mmcache, mm);
+  return 0;
+}
+
+// Let p use address space mm as well, mapping p's trapframe
+// into it for trampoline.S. The caller sets p->mm.
+// Returns 0, or -1 if out of memory.
+int
+mmget(struct mm *mm, struct proc *p)
+{
+  int r;
+
+  acquire(&mm->lock);
+  r = mappages(mm->pagetable, TRAPFRAME(p - proc), PGSIZE,
+               (uint64)(p->trapframe), PTE_R | PTE_W);
+  if(r == 0){
+    mm->ref++;
+    // a thread that had this slot before may have left
+    // its trapframe in some hart's TLB.
+    mm->tlbcpus = 0;
   }
+  release(&mm->lock);
+  return r < 0 ? -1 : 0;
+}
+
+// p no longer uses mm. The last process to let go of it
+// writes back and unmaps its mmaps, which sleeps, and
+// frees it along with the memory it maps.
+void
+mmput(struct mm *mm, struct proc *p)
+{
+  int last;
+
+  acquire(&mm->lock);
+  uvmunmap(mm->pagetable, TRAPFRAME(p - proc), 1, 0);
+  last = --mm->ref == 0;
+  release(&mm->lock);
+  if(!last)
+    return;
+
+  vmaclear(mm);
+  uvmunmap(mm->pagetable, TRAMPOLINE, 1, 0);
+  uvmfree(mm->pagetable, mm->sz);
+  freelock(&mm->lock);
+  kmem_cache_free(mmcache, mm);
+}
 
-  // map the trapframe just below TRAMPOLINE, for trampoline.S.
-  if(mappages(pagetable, TRAPFRAME, PGSIZE,
-              (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
-    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-    uvmfree(pagetable, 0);
+// Allocate a table of open files with none open, or a copy
+// of fs if it isn't 0, each file and the current directory
+// referred to once more. If fds isn't 0 as well, the copy
+// has only fs's files fds[0], fds[1] and fds[2], as fds 0, 1
+// and 2; an fd that isn't open is left closed.
+// Returns 0 if out of memory.
+struct files *
+filesalloc(struct files *fs, int *fds)
+{
+  struct files *nfs;
+  int i, fd;
+
+  if((nfs = kmem_cache_alloc(filescache)) == 0)
     return 0;
+  memset(nfs, 0, sizeof(*nfs));
+  initlock(&nfs->lock, "files");
+  nfs->ref = 1;
+  if(fs){
+    acquire(&fs->lock);
+    for(i = 0; i < NOFILE; i++){
+      fd = i;
+      if(fds)
+        fd = i < 3 ? fds[i] : -1;
+      if(fd >= 0 && fd < NOFILE && fs->ofile[fd])
+        nfs->ofile[i] = filedup(fs->ofile[fd]);
+    }
+    nfs->cwd = idup(fs->cwd);
+    release(&fs->lock);
   }
+  return nfs;
+}
 
-  return pagetable;
+// Return a new reference to the current directory, which
+// another thread may change at any time.
+struct inode*
+cwd(void)
+{
+  struct files *fs = myproc()->files;
+  struct inode *ip;
+
+  acquire(&fs->lock);
+  ip = idup(fs->cwd);
+  release(&fs->lock);
+  return ip;
 }
 
-// Free a process's page table, and free the
-// physical memory it refers to.
+// Drop a reference to fs. The last one closes the files
+// and lets go of the current directory.
 void
-proc_freepagetable(pagetable_t pagetable, uint64 sz)
+filesput(struct files *fs)
 {
-  uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-  uvmunmap(pagetable, TRAPFRAME, 1, 0);
-  uvmfree(pagetable, sz);
+  int last;
+
+  acquire(&fs->lock);
+  last = --fs->ref == 0;
+  release(&fs->lock);
+  if(!last)
+    return;
+
+  for(int fd = 0; fd < NOFILE; fd++){
+    if(fs->ofile[fd]){
+      fileclose(fs->ofile[fd]);
+      fs->ofile[fd] = 0;
+    }
+  }
+  begin_op();
+  iput(fs->cwd);
+  end_op();
+  freelock(&fs->lock);
+  kmem_cache_free(filescache, fs);
 }
 
 // a user program that calls exec("/init")
@@ -229,41 +388,69 @@ userinit(void)
 
   p = allocproc();
   initproc = p;
+  if((p->mm = mmalloc(p)) == 0 || (p->files = filesalloc(0, 0)) == 0)
+    panic("userinit");
+  p->pagetable = p->mm->pagetable;
   
   // allocate one user page and copy init's instructions
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  p->mm->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
   p->trapframe->sp = PGSIZE;  // user stack pointer
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  p->files->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
+// Growing only moves mm->sz; uvmfault() allocates
+// each page when it is first touched.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz, oldsz;
   struct proc *p = myproc();
+  struct mm *mm = p->mm;
 
-  sz = p->sz;
+  acquire(&mm->lock);
+  oldsz = sz = mm->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    if(sz + n < sz || sz + n > vmalimit(p)){
+      release(&mm->lock);
       return -1;
     }
+    sz += n;
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    if(sz + n > sz){
+      release(&mm->lock);
+      return -1;
+    }
+    sz += n;
+    // a superpage across the new end is split now, so
+    // that unmapping what lies past it can't fail below.
+    if(uvmsplit(mm->pagetable, PGROUNDUP(sz)) < 0){
+      release(&mm->lock);
+      return -1;
+    }
+    // memory that grows back must come back zeroed,
+    // not re-read from a file-backed region.
+    for(struct vma *v = mm->vma; v < &mm->vma[NVMA]; v++){
+      if(v->type == VMA_EXEC && v->end > PGROUNDUP(sz))
+        v->end = v->start > PGROUNDUP(sz) ? v->start : PGROUNDUP(sz);
+    }
   }
-  p->sz = sz;
+  mm->sz = sz;
+  release(&mm->lock);
+  if(PGROUNDUP(sz) < PGROUNDUP(oldsz))
+    uvmunmapsync(mm, PGROUNDUP(sz), (PGROUNDUP(oldsz) - PGROUNDUP(sz)) / PGSIZE);
   return 0;
 }
 
@@ -272,22 +459,43 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid, r, retried = 0;
   struct proc *np;
   struct proc *p = myproc();
 
+again:
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  if((np->mm = mmalloc(np)) == 0){
+    r = -1;
+  } else {
+    np->pagetable = np->mm->pagetable;
+    acquire(&p->mm->lock);
+    r = uvmcopy(p->pagetable, np->pagetable, p->mm->sz);
+    if(r == 0)
+      r = vmadup(np, p);
+    np->mm->sz = p->mm->sz;
+    release(&p->mm->lock);
+  }
+  if(r < 0 || (np->files = filesalloc(p->files, 0)) == 0){
+    // letting go of the copy sleeps.
+    release(&np->lock);
+    if(np->mm)
+      mmput(np->mm, np);
+    np->mm = 0;
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
+    // out of memory for the child's page table: swap
+    // some pages out and try once more.
+    if(!retried++ && reclaim() > 0)
+      goto again;
     return -1;
   }
-  np->sz = p->sz;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -295,11 +503,62 @@ fork(void)
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
-  // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  // the parent's writable pages are copy-on-write now, and
+  // its other threads must see that before the child runs.
+  tlbshootdown(p->mm);
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->nice = np->prio = p->nice;
+  np->affinity = p->affinity;
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a thread: a new process that shares the current
+// one's address space, open files and current directory,
+// and starts at fn(arg) with stack pointer stack. fn must
+// not return; the thread ends by calling exit(). It is a
+// child of the current process, which waits for it with
+// wait(), and exit() kills it if it is still running.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  if(mmget(p->mm, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->mm = p->mm;
+  np->pagetable = p->pagetable;
+  np->files = p->files;
+  acquire(&np->files->lock);
+  np->files->ref++;
+  release(&np->files->lock);
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack & ~0xf;  // riscv sp must be 16-byte aligned
+  np->trapframe->ra = 0;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -312,7 +571,59 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->nice = np->prio = p->nice;
+  np->affinity = p->affinity;
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a child process running the program at path with
+// arguments argv, as fork() and exec() would, but building
+// its address space straight from the program rather than
+// copying the current one only to throw the copy away.
+// The child gets the current process's open files, or, if
+// fds isn't 0, only fds[0], fds[1] and fds[2], as its fds 0,
+// 1 and 2 (see filesalloc()).
+// Returns the child's pid, or -1.
+int
+spawn(char *path, char **argv, int *fds)
+{
+  int argc, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  // nothing runs np until setrunnable(), so exec() may
+  // sleep building its image without np->lock.
+  release(&np->lock);
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = exec(np, path, argv)) < 0 ||
+     (np->files = filesalloc(p->files, fds)) == 0){
+    // letting go of the image sleeps.
+    if(np->mm)
+      mmput(np->mm, np);
+    np->mm = 0;
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+
+  pid = np->pid;
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->nice = np->prio = p->nice;
+  np->affinity = p->affinity;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -340,23 +651,39 @@ void
 exit(int status)
 {
   struct proc *p = myproc();
+  struct proc *pp;
+  struct mm *mm;
 
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
+  // Threads p made don't outlive it.
+  acquire(&wait_lock);
+  for(pp = proc; pp < &proc[NPROC]; pp++){
+    if(pp->parent == p){
+      acquire(&pp->lock);
+      if(pp->mm == p->mm){
+        pp->killed = 1;
+        if(pp->state == SLEEPING)
+          setrunnable(pp);
+      }
+      release(&pp->lock);
     }
   }
+  release(&wait_lock);
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
+  // Close all open files, unless other threads share them.
+  filesput(p->files);
+  p->files = 0;
+
+  // Write back and unmap mmaps, release exec segments and
+  // free user memory, unless other threads share them.
+  acquire(&p->lock);
+  mm = p->mm;
+  p->mm = 0;
+  p->pagetable = 0;
+  release(&p->lock);
+  mmput(mm, p);
 
   acquire(&wait_lock);
 
@@ -387,6 +714,10 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the copyout below holds spinlocks, so it must not sleep.
+  if(addr != 0)
+    uvmtouch(p, addr, sizeof(int), 1);
+
   acquire(&wait_lock);
 
   for(;;){
@@ -427,13 +758,276 @@ wait(uint64 addr)
   }
 }
 
+// The scheduler is a multi-level feedback queue. A process
+// runs at one of NPRIO priority levels, and a cpu runs the
+// first process queued at the highest level. A process
+// starts at the top level it may use (see setpriority())
+// and drops a level each time it runs for a whole time
+// slice, which doubles at each level down; one that sleeps
+// before then, like a shell waiting for input, stays where
+// it is. A process queued at a higher level than the one
+// running takes over the cpu at the next tick, so a shell
+// woken at the top level waits at most about a tick while
+// CPU-bound processes run below it. Every BOOST ticks,
+// all processes go back to their top levels, so that none
+// waits forever.
+
+#define SLICE(prio) (1 << (prio))  // ticks
+
+static uint epoch;  // boosts so far
+
+// Move p back up to its top level if there has been a
+// boost since p was last moved, and down to it if p is
+// above it.
+static void
+reprio(struct proc *p)
+{
+  if(p->epoch != epoch || p->prio < p->nice){
+    p->epoch = epoch;
+    p->prio = p->nice;
+    p->quantum = 0;
+  }
+}
+
+// Add p to the tail of its level of run queue q.
+// Caller holds q->lock.
+static void
+runqappend(struct runq *q, struct proc *p)
+{
+  p->rqnext = 0;
+  if(q->tail[p->prio])
+    q->tail[p->prio]->rqnext = p;
+  else
+    q->head[p->prio] = p;
+  q->tail[p->prio] = p;
+  q->n++;
+}
+
+static void
+runqput(struct runq *q, struct proc *p)
+{
+  acquire(&q->lock);
+  runqappend(q, p);
+  release(&q->lock);
+}
+
+// Take the first process at the highest level of run
+// queue q that may run on cpu c, or any if c is 0.
+// Returns 0 if there is none.
+static struct proc *
+runqget(struct runq *q, struct cpu *c)
+{
+  struct proc *p = 0, *prev;
+  int i;
+
+  acquire(&q->lock);
+  for(i = 0; i < NPRIO; i++){
+    for(prev = 0, p = q->head[i]; p; prev = p, p = p->rqnext)
+      if(c == 0 || ALLOWED(p, c))
+        break;
+    if(p){
+      if(prev)
+        prev->rqnext = p->rqnext;
+      else
+        q->head[i] = p->rqnext;
+      if(q->tail[i] == p)
+        q->tail[i] = prev;
+      q->n--;
+      break;
+    }
+  }
+  release(&q->lock);
+  return p;
+}
+
+// The cpu p should wait to run on: the one it last ran on,
+// whose cache and TLB may still hold its memory, or else
+// this one, or else the first that p may run on.
+static struct cpu *
+placement(struct proc *p)
+{
+  struct cpu *c;
+
+  if(p->cpu >= 0 && ALLOWED(p, &cpus[p->cpu]))
+    return &cpus[p->cpu];
+  if(ALLOWED(p, mycpu()))
+    return mycpu();
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    if(c->online && ALLOWED(p, c))
+      return c;
+  return mycpu();
+}
+
+// Mark p RUNNABLE and queue it to run (see placement()).
+// A cpu with nothing to run takes processes from the
+// others' queues (see scheduler()).
+// Caller must hold p->lock.
+void
+setrunnable(struct proc *p)
+{
+  struct cpu *c = placement(p);
+  struct cpu *v;
+
+  p->state = RUNNABLE;
+  reprio(p);
+  runqput(&c->rq, p);
+  // if c is idle, wake it. if it is busy, and p isn't
+  // just giving c up, wake an idle cpu to take p instead.
+  if(c->idle){
+    cpuwake(c);
+  } else if(p != myproc()){
+    for(v = cpus; v < &cpus[NCPU]; v++){
+      if(v->idle && ALLOWED(p, v)){
+        cpuwake(v);
+        break;
+      }
+    }
+  }
+}
+
+// Interrupt cpu c: end its wait in cpuidle(), or have it
+// look at c->tlbreq, by making its timer go off now.
+void
+cpuwake(struct cpu *c)
+{
+  __atomic_store_n(&c->wake, 1, __ATOMIC_SEQ_CST);
+  *(volatile uint64*)CLINT_MTIMECMP(c - cpus) = 0;
+}
+
+// Called by scheduler(), with nothing to run, to wait for
+// an interrupt. So that an idle hart costs nothing, it
+// waits in wfi, with its clock ticks stopped until the
+// next timeout is due, or until setrunnable() gives it
+// something to run.
+static void
+cpuidle(struct cpu *c)
+{
+  volatile uint64 *mtimecmp = (uint64*)CLINT_MTIMECMP(cpuid());
+  uint64 t0, deadline;
+  uint tick;
+
+  intr_off();
+  c->idle = 1;
+  __sync_synchronize();
+  deadline = timernext(&tick) ? (uint64)tick * TICKCYCLES : ~0ULL;
+  if(deadline > *mtimecmp)
+    *mtimecmp = deadline;
+  // a setrunnable() that queued a process before we set
+  // c->idle is seen here. A cpuwake() may have moved
+  // mtimecmp back before our write undid it, for a process
+  // queued on this cpu or on another one to steal from, so
+  // c->wake says to look again rather than wait.
+  __sync_synchronize();
+  t0 = r_time();
+  if(c->rq.n == 0 && !__atomic_load_n(&c->wake, __ATOMIC_SEQ_CST))
+    asm volatile("wfi");
+  c->idletime += r_time() - t0;
+  c->idle = 0;
+  // scheduler() looks at every queue after this.
+  __atomic_store_n(&c->wake, 0, __ATOMIC_SEQ_CST);
+  __sync_synchronize();
+  // tick again, even if a device interrupt woke us.
+  if(*mtimecmp > r_time() + TICKCYCLES)
+    *mtimecmp = r_time() + TICKCYCLES;
+  intr_on();
+}
+
+// Called on a timer interrupt while the current process
+// runs. Charges it for the tick, and gives up the cpu if
+// it has used up its time slice, or if a process of higher
+// priority is waiting for this cpu.
+void
+schedtick(void)
+{
+  struct proc *p = myproc();
+  struct runq *q;
+  int i, preempt;
+
+  acquire(&p->lock);
+  reprio(p);
+  if((preempt = ++p->quantum >= SLICE(p->prio)) != 0){
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->quantum = 0;
+  }
+  // the queue heads are only a hint; a process queued
+  // just after we look waits for the next tick.
+  q = &mycpu()->rq;
+  for(i = 0; i < p->prio && !preempt; i++)
+    preempt = q->head[i] != 0;
+  if(preempt){
+    setrunnable(p);
+    sched();
+  }
+  release(&p->lock);
+}
+
+// Called by clockintr() every BOOST ticks. Moves queued
+// processes back up to their top levels at once; the rest
+// move the next time they run or are queued (see reprio()).
+void
+schedboost(void)
+{
+  struct cpu *c;
+  struct proc *p, *next, *head[NPRIO];
+  int i;
+
+  epoch++;
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    acquire(&c->rq.lock);
+    for(i = 0; i < NPRIO; i++){
+      head[i] = c->rq.head[i];
+      c->rq.head[i] = c->rq.tail[i] = 0;
+    }
+    c->rq.n = 0;
+    // requeue in order of priority, so that the processes
+    // that were waiting highest still go first.
+    for(i = 0; i < NPRIO; i++){
+      for(p = head[i]; p; p = next){
+        next = p->rqnext;
+        reprio(p);
+        runqappend(&c->rq, p);
+      }
+    }
+    release(&c->rq.lock);
+  }
+}
+
+// Take a process that may run on idle cpu c from the cpu
+// with the most waiting in its queue, or failing that from
+// any other. Returns 0 if none is waiting.
+static struct proc *
+runqsteal(struct cpu *c)
+{
+  struct cpu *v, *busiest = 0;
+  struct proc *p = 0;
+
+  // the counts are only a hint; runqget() takes the lock.
+  for(v = cpus; v < &cpus[NCPU]; v++)
+    if(v != c && v->rq.n > 0 && (busiest == 0 || v->rq.n > busiest->rq.n))
+      busiest = v;
+  if(busiest == 0)
+    return 0;
+  if((p = runqget(&busiest->rq, c)) == 0){
+    for(v = cpus; v < &cpus[NCPU] && p == 0; v++)
+      if(v != c && v != busiest && v->rq.n > 0)
+        p = runqget(&v->rq, c);
+  }
+  if(p)
+    c->nsteal++;
+  return p;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take the next process from this CPU's run queue,
+//    or if it is empty, from another CPU's.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
+// A process is on a run queue exactly when it is RUNNABLE,
+// except between the scheduler taking it off and running it.
 void
 scheduler(void)
 {
@@ -441,26 +1035,48 @@ scheduler(void)
   struct cpu *c = mycpu();
   
   c->proc = 0;
+  c->online = 1;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
+    if((p = runqget(&c->rq, 0)) == 0 && (p = runqsteal(c)) == 0){
+      // nothing to run: this hart is idle.
+#ifdef KSM
+      ksmscan();
+#endif
+      cpuidle(c);
+      continue;
+    }
+
+    // if p has just yielded on another cpu, this waits
+    // for that cpu to finish switching away from it.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+    if(!ALLOWED(p, c)){
+      // setaffinity() has moved p off this cpu.
+      setrunnable(p);
       release(&p->lock);
+      continue;
     }
+    if(p->cpu >= 0 && p->cpu != cpuid()){
+      p->nmigrate++;
+      c->nmigrate++;
+    }
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->cpu = cpuid();
+    c->proc = p;
+    c->nswitch++;
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -497,7 +1113,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -529,47 +1145,190 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *q = WAITQ(chan);
+  int queued;
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once p is on q and we hold p->lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks q and then p->lock),
   // so it's okay to release lk.
 
+  acquire(&q->lock);
   acquire(&p->lock);  //DOC: sleeplock1
-  release(lk);
-
-  // Go to sleep.
   p->chan = chan;
-  p->state = SLEEPING;
+  p->wqnext = q->head;
+  q->head = p;
+  release(&q->lock);
+  release(lk);
 
-  sched();
+  // Go to sleep, unless sleeptimeout()'s time has run out
+  // already.
+  if(!p->timedout){
+    p->state = SLEEPING;
+    sched();
+  }
 
-  // Tidy up.
-  p->chan = 0;
+  // Tidy up. wakeup() took p off q, unless it was
+  // kill() or a timeout that woke p. A wakeup() may yet do
+  // so before this takes q->lock, so look again after.
+  queued = p->chan != 0;
+  release(&p->lock);
+  if(queued){
+    acquire(&q->lock);
+    acquire(&p->lock);
+    if(p->chan != 0)
+      waitqremove(q, p);
+    release(&p->lock);
+    release(&q->lock);
+  }
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
-// Wake up all processes sleeping on chan.
-// Must be called without any p->lock.
-void
-wakeup(void *chan)
+// Called from the clock interrupt when the time of a
+// sleeptimeout() runs out.
+static void
+timedout(void *arg)
 {
-  struct proc *p;
+  struct proc *p = arg;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
+  acquire(&p->lock);
+  p->timedout = 1;
+  if(p->state == SLEEPING)
+    setrunnable(p);
+  release(&p->lock);
+}
+
+// Like sleep(), but give up waiting after n ticks.
+// Returns 0 if woken, -1 if the time ran out.
+int
+sleeptimeout(void *chan, struct spinlock *lk, uint n)
+{
+  struct proc *p = myproc();
+  struct timer t;
+  int r;
+
+  timeradd(&t, n, timedout, p);
+  sleep(chan, lk);
+  timerdel(&t);
+  acquire(&p->lock);
+  r = p->timedout ? -1 : 0;
+  p->timedout = 0;
+  release(&p->lock);
+  return r;
+}
+
+// Take p off wait queue q.
+// Caller holds q->lock and p->lock.
+static void
+waitqremove(struct waitq *q, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &q->head; *pp != p; pp = &(*pp)->wqnext)
+    ;
+  *pp = p->wqnext;
+  p->chan = 0;
+}
+
+// Wake up processes sleeping on chan: all of them, or
+// only the one that has waited longest. Those that kill()
+// or a timeout woke already just come off the queue.
+// Returns how many it woke.
+static int
+wake(void *chan, int all)
+{
+  struct waitq *q = WAITQ(chan);
+  struct proc *p, *next, *oldest;
+  int n = 0;
+
+  acquire(&q->lock);
+  do {
+    oldest = 0;
+    for(p = q->head; p; p = next){
+      next = p->wqnext;
+      if(p->chan != chan)
+        continue;
       acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+      if(p->state != SLEEPING){
+        waitqremove(q, p);
+      } else if(all){
+        waitqremove(q, p);
+        setrunnable(p);
+        n++;
+      } else {
+        oldest = p;  // the newest are at the head
       }
       release(&p->lock);
     }
+    if(oldest){
+      acquire(&oldest->lock);
+      waitqremove(q, oldest);
+      // kill() doesn't take q->lock, so may have beaten us.
+      if(oldest->state == SLEEPING){
+        setrunnable(oldest);
+        n++;
+      }
+      release(&oldest->lock);
+    }
+  } while(oldest && n == 0);
+  release(&q->lock);
+  return n;
+}
+
+// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
+void
+wakeup(void *chan)
+{
+  wake(chan, 1);
+}
+
+// Wake up the process that has slept longest on chan, for
+// when only one of them can go on, like the next holder
+// of a lock. Must be called without any p->lock.
+void
+wakeone(void *chan)
+{
+  wake(chan, 0);
+}
+
+// futex(addr, FUTEX_WAIT, val) sleeps until woken if the
+// user int at addr is still val; futex(addr, FUTEX_WAKE, n)
+// wakes up to n of the processes waiting on addr, those that
+// have waited longest first. Waiters sleep on the physical
+// address of the int, so that threads, and processes that
+// map the same file MAP_SHARED, or share anonymous memory
+// across fork(), find each other (see vmaload() in vm.c,
+// and mmap()); futex_lock makes
+// looking at the int and going to sleep atomic with respect
+// to FUTEX_WAKE. FUTEX_WAIT returns 0 once woken, or at once
+// if the int has changed, and FUTEX_WAKE the number woken.
+int
+futex(uint64 addr, int op, int val)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+  int n = 0;
+
+  if(op != FUTEX_WAIT && op != FUTEX_WAKE)
+    return -1;
+  if((pa = uvmword(p, addr)) == 0)
+    return -1;
+  acquire(&futex_lock);
+  if(op == FUTEX_WAIT){
+    if(*(int*)pa == val && !p->killed)
+      sleep((void*)pa, &futex_lock);
+  } else {
+    while(n < val && wake((void*)pa, 0))
+      n++;
   }
+  release(&futex_lock);
+  kfree((void*)PGROUNDDOWN(pa));
+  return n;
 }
 
 // Kill the process with the given pid.
@@ -586,7 +1345,7 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable(p);
       }
       release(&p->lock);
       return 0;
@@ -632,13 +1391,6 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
 void
 procdump(void)
 {
-  static char *states[] = {
-  [UNUSED]    "unused",
-  [SLEEPING]  "sleep ",
-  [RUNNABLE]  "runble",
-  [RUNNING]   "run   ",
-  [ZOMBIE]    "zombie"
-  };
   struct proc *p;
   char *state;
 
@@ -654,3 +1406,141 @@ procdump(void)
     printf("\n");
   }
 }
+
+// Fill in *ru for process pid, or for the current process
+// if pid is 0. If no process has that pid, describe the one
+// with the next higher pid instead, so that ps can find every
+// process. Returns the pid described, or -1 if there is none.
+int
+getrusage(int pid, struct rusage *ru)
+{
+  struct proc *p, *found;
+  int fpid;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+
+  acquire(&wait_lock);
+again:
+  found = 0;
+  fpid = 0;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state != UNUSED && p->pid >= pid && (found == 0 || p->pid < fpid)){
+      found = p;
+      fpid = p->pid;
+    }
+    release(&p->lock);
+  }
+  if(found == 0){
+    release(&wait_lock);
+    return -1;
+  }
+
+  p = found;
+  acquire(&p->lock);
+  if(p->state == UNUSED || p->pid != fpid){
+    // freed while we looked.
+    release(&p->lock);
+    goto again;
+  }
+  memset(ru, 0, sizeof(*ru));
+  ru->pid = p->pid;
+  ru->ppid = p->parent ? p->parent->pid : 0;
+  safestrcpy(ru->state, states[p->state], sizeof(ru->state));
+  safestrcpy(ru->name, p->name, sizeof(ru->name));
+  ru->prio = p->prio;
+  ru->nice = p->nice;
+  ru->cpu = p->cpu;
+  ru->affinity = p->affinity;
+  ru->nmigrate = p->nmigrate;
+  ru->sz = p->mm ? p->mm->sz : 0;
+  ru->minflt = p->minflt;
+  ru->majflt = p->majflt;
+  if(p->pagetable)
+    uvmusage(p->pagetable, ru);
+  release(&p->lock);
+  release(&wait_lock);
+  return fpid;
+}
+
+// Let process pid, or the current process if pid is 0, run
+// only at priority level nice and below. A process that is
+// running or asleep moves to level nice at once; one in a
+// run queue moves down when it next runs, or up at the next
+// boost. Returns the old value, or -1 if there is no such
+// process.
+int
+setpriority(int pid, int nice)
+{
+  struct proc *p;
+  int old;
+
+  if(nice < 0 || nice >= NPRIO)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state != UNUSED && p->pid == pid){
+      old = p->nice;
+      p->nice = nice;
+      if(p->state != RUNNABLE){
+        p->prio = nice;
+        p->quantum = 0;
+      }
+      release(&p->lock);
+      return old;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// Let process pid, or the current process if pid is 0, run
+// only on the cpus in mask, a bit for each. The current
+// process yields, so as to move at once if it must; another
+// process moves the next time it is scheduled.
+// Returns 0, or -1 if there is no such process or mask
+// has no cpu that is running.
+int
+setaffinity(int pid, int mask)
+{
+  struct proc *p;
+  struct cpu *c;
+  int online = 0;
+
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    if(c->online)
+      online |= 1 << (c - cpus);
+  if((mask & online) == 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state != UNUSED && p->pid == pid){
+      p->affinity = mask & ALLCPUS;
+      release(&p->lock);
+      if(p == myproc())
+        yield();
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+int
+statssched(char *buf, int sz)
+{
+  struct cpu *c;
+  int n = 0;
+
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    if(c->nswitch > 0)
+      n += snprintf(buf+n, sz-n, "--- scheduler: cpu %d switches %d steals %d migrations %d queued %d idle %d\n",
+                    (int)(c - cpus), c->nswitch, c->nsteal, c->nmigrate, c->rq.n,
+                    (int)(c->idletime / TICKCYCLES));
+  return n;
+}
@@ -18,19 +18,40 @@ struct context {
   uint64 s11;
 };
 
+// RUNNABLE processes waiting for a cpu: a queue for each
+// priority level, linked through p->rqnext, in the order
+// they are to run.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  int n;
+};
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint asidgen;               // ASID generation the TLB was last flushed for
+  struct runq rq;             // Processes waiting to run on this cpu.
+  uint nswitch;               // Processes run
+  uint nsteal;                // of which taken from another cpu's queue
+  int idle;                   // Waiting in cpuidle() for something to run
+  int wake;                   // cpuwake() since cpuidle() last returned
+  int online;                 // Has entered scheduler()
+  uint nmigrate;              // Processes run that last ran on another cpu
+  uint64 idletime;            // Cycles spent in cpuidle()
+  int tlbreq;                 // tlbshootdown() wants the TLB flushed
 };
 
 extern struct cpu cpus[NCPU];
 
 // per-process data for the trap handling code in trampoline.S.
-// sits in a page by itself just under the trampoline page in the
-// user page table. not specially mapped in the kernel page table.
+// sits in a page by itself under the trampoline page in the user
+// page table, at TRAPFRAME(i) for proc[i]. not specially mapped
+// in the kernel page table.
 // the sscratch register points here.
 // uservec in trampoline.S saves user registers in the trapframe,
 // then initializes registers from the trapframe's
@@ -80,6 +101,48 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A region of user memory whose pages are filled in when first
+// touched: an ELF segment mapped by exec, or an mmap.
+// A file-backed page at va holds the file's bytes from
+// off + (va - start), for up to filesz bytes past start;
+// the rest, and all of an anonymous mmap, is zero.
+// A VMA_UNMAP holds on to the range of an mmap that munmap()
+// is still tearing down, where nothing may be mapped or faulted.
+struct vma {
+  enum { VMA_NONE, VMA_EXEC, VMA_MMAP, VMA_UNMAP } type;
+  uint64 start;                // page-aligned
+  uint64 end;                  // page-aligned
+  int prot;                    // VMA_MMAP: PROT_READ, PROT_WRITE, PROT_EXEC
+  int flags;                   // VMA_MMAP: MAP_SHARED or MAP_PRIVATE, MAP_ANONYMOUS
+  struct inode *ip;            // file the pages come from, or 0
+  struct file *f;              // VMA_MMAP of a file: holds it open
+  uint off;                    // file offset of start
+  uint filesz;                 // bytes that come from the file
+};
+
+// A user address space, shared by the threads of a process
+// (see clone()). mm->lock must be held to change the page
+// table or the regions, or to use tlbcpus.
+struct mm {
+  struct spinlock lock;
+  int ref;                     // procs using it
+  uint64 sz;                   // Size of process memory (bytes)
+  pagetable_t pagetable;       // User page table
+  int asid;                    // TLB tag for pagetable (see uvmsatp())
+  uint asidgen;                // generation of asid, 0 if none yet
+  uint tlbcpus;                // harts whose TLBs are up to date for asid
+  uint64 swapva;               // where reclaim() last left off in pagetable
+  struct vma vma[NVMA];        // exec segments and mmaps
+};
+
+// Open files and current directory, shared by threads.
+struct files {
+  struct spinlock lock;
+  int ref;
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -90,19 +153,43 @@ struct proc {
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
+  int timedout;                // sleeptimeout()'s time ran out
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int affinity;                // cpus p may run on, a bit for each (a hint without p->lock)
+  uint nmigrate;               // times p has moved to another cpu
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
 
+  // the lock of the run queue p is on must be held when using this:
+  struct proc *rqnext;         // Next in run queue
+
+  // the lock of the wait queue p is on must be held when using this,
+  // and to change p->chan:
+  struct proc *wqnext;         // Next in wait queue
+
+  int cpu;                     // cpu p last ran on, or -1
+
+  // p->lock, or while p is queued its run queue's lock,
+  // must be held when using these (see schedtick()):
+  int nice;                    // highest priority level p may run at
+  int prio;                    // priority level, 0 the highest
+  int quantum;                 // ticks run at prio
+  uint epoch;                  // boost prio was last reset for
+
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  struct mm *mm;               // Address space (p->lock to change)
+  pagetable_t pagetable;       // User page table, p->mm's
+  struct files *files;         // Open files and current directory
+  uint64 pinva;                // user memory uvmtouch()ed for the current
+  uint64 pinend;               //   system call, which reclaim() leaves be
+  uint64 cowold[NCOWOLD];      // pages copied from under a spinlock, to let go
+  int ncowold;                 //   of at the end of the system call (see cowdrain())
+  uint64 minflt;               // page faults served from memory
+  uint64 majflt;               // page faults that read a file or swap
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 };
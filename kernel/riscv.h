@@ -198,6 +198,12 @@ w_pmpaddr0(uint64 x)
 
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
 
+// the address-space ID field of satp: TLB entries are
+// tagged with it, so switching between page tables with
+// different ASIDs needs no flush.
+#define SATP_ASID(asid) (((uint64)(asid) & 0xFFFF) << 44)
+#define SATP2ASID(satp) (((satp) >> 44) & 0xFFFF)
+
 // supervisor address translation and protection;
 // holds the address of the page table.
 static inline void 
@@ -260,6 +266,23 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor Counter-Enable
+static inline void 
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+static inline uint64
+r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
+#define COUNTEREN_TM (1L << 1) // time CSR readable from the next mode down
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -331,6 +354,20 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB entries of one address space.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid));
+}
+
+// flush the TLB entry for va in one address space.
+static inline void
+sfence_vma_page(uint64 va, uint64 asid)
+{
+  asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid));
+}
+
 
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
@@ -338,11 +375,22 @@ sfence_vma()
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
 
+// a superpage (megapage) is mapped by one level-1 leaf PTE.
+#define SUPERPGSIZE (PGSIZE << 9) // 2MB
+#define SUPERORDER  9             // buddy order of a superpage
+#define SUPERPGROUNDUP(sz)  (((sz)+SUPERPGSIZE-1) & ~(SUPERPGSIZE-1))
+#define SUPERPGROUNDDOWN(a) (((a)) & ~(SUPERPGSIZE-1))
+
 #define PTE_V (1L << 0) // valid
 #define PTE_R (1L << 1)
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_A (1L << 6) // accessed
+#define PTE_D (1L << 7) // dirty
+#define PTE_COW (1L << 8) // RSW: shared copy-on-write; write faults copy it
+#define PTE_SUPER (1L << 9) // RSW: a level-1 leaf, mapping a superpage
+#define PTE_SWAP (1L << 9)  // RSW, with PTE_V clear: swapped out; the PPN is a swap slot
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
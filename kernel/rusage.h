@@ -0,0 +1,20 @@
+// Resource usage of a process, from getrusage().
+// Memory is counted in pages; a page that several processes
+// share counts for each of them.
+struct rusage {
+  int pid;
+  int ppid;
+  char state[8];
+  char name[16];
+  int prio;         // scheduler priority level, 0 the highest
+  int nice;         // highest level it may run at
+  int cpu;          // cpu it last ran on, or -1
+  int affinity;     // cpus it may run on, a bit for each
+  uint nmigrate;    // times it has moved to another cpu
+  uint64 sz;        // size of the heap and below, in bytes
+  uint64 rss;       // resident pages
+  uint64 swapped;   // pages out in swap
+  uint64 ptpages;   // page-table pages
+  uint64 minflt;    // page faults served from memory
+  uint64 majflt;    // page faults that read a file or swap
+};
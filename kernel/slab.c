@@ -0,0 +1,320 @@
+// Slab allocator for small kernel objects, built on kalloc_pages().
+//
+// A cache hands out objects of one fixed size. It carves
+// buddy blocks ("slabs") into objects; each slab starts with a
+// struct slab header, so an object's slab is found by rounding
+// the object's address down to the slab's size. Slabs move
+// between the cache's full, partial and empty lists.
+//
+// Each CPU keeps a small magazine of free objects per cache,
+// so most allocations and frees touch neither the cache lock
+// nor the page allocator. An empty magazine is refilled, and a
+// full one half-flushed, under the cache lock.
+//
+// kmalloc()/kmfree() sit on a set of power-of-two caches for
+// callers that don't want a cache of their own.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NCACHE     16   // max caches
+#define MAGSIZE    16   // objects in a per-CPU magazine
+#define MINOBJS    4    // a slab holds at least this many objects
+#define KMALLOC_MIN 16
+#define KMALLOC_MAX 512   // larger kmalloc()s get a whole page
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;      // on one of the cache's lists
+  struct slab *prev;
+  void *freelist;         // free objects, linked through their first word
+  int inuse;              // allocated objects, including those in magazines
+};
+
+struct magazine {
+  int n;                  // objects in objs[]
+  void *objs[MAGSIZE];
+  uint hits;              // allocations served from objs[]
+  uint misses;            // allocations that had to refill
+};
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;              // object size, rounded up for alignment
+  int order;              // each slab is 2^order pages
+  int perslab;            // objects per slab
+  struct slab *full;
+  struct slab *partial;
+  struct slab *empty;     // at most one, kept to avoid thrashing
+  int nslab;              // slabs owned by this cache
+  int nalloc;             // objects handed out to callers
+  struct magazine mag[NCPU];
+};
+
+static struct {
+  struct spinlock lock;
+  struct kmem_cache caches[NCACHE];
+  int n;
+} slabs;
+
+static struct kmem_cache *kmalloc_caches[6];  // 16 .. 512 bytes
+static char kmalloc_names[6][16];
+
+// size of the slab header, rounded so objects stay aligned.
+#define SLABHDR  ((sizeof(struct slab) + 15) & ~15L)
+
+static void
+list_remove(struct slab **head, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *head = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+static void
+list_push(struct slab **head, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *head;
+  if(*head)
+    (*head)->prev = s;
+  *head = s;
+}
+
+// Create a cache of objects of the given size.
+// The name must stay valid for as long as the cache.
+struct kmem_cache *
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  if(size == 0 || size > PGSIZE)
+    panic("kmem_cache_create: size");
+
+  acquire(&slabs.lock);
+  if(slabs.n >= NCACHE)
+    panic("kmem_cache_create: too many caches");
+  c = &slabs.caches[slabs.n++];
+  release(&slabs.lock);
+
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  for(c->order = 0; c->order < 2; c->order++)
+    if(((PGSIZE << c->order) - SLABHDR) / c->size >= MINOBJS)
+      break;
+  c->perslab = ((PGSIZE << c->order) - SLABHDR) / c->size;
+  return c;
+}
+
+// Allocate and carve a new slab for c.
+// Caller must hold c->lock.
+static struct slab *
+slab_grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  int i;
+
+  if((s = kalloc_pages(c->order)) == 0)
+    return 0;
+  s->cache = c;
+  s->next = s->prev = 0;
+  s->inuse = 0;
+  s->freelist = 0;
+  obj = (char*)s + SLABHDR;
+  for(i = 0; i < c->perslab; i++, obj += c->size){
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+  }
+  c->nslab++;
+  return s;
+}
+
+static struct slab *
+obj2slab(struct kmem_cache *c, void *obj)
+{
+  return (struct slab *)((uint64)obj & ~((uint64)(PGSIZE << c->order) - 1));
+}
+
+// Take up to n objects from c's slabs into objs[].
+// Caller must hold c->lock. Returns how many were taken.
+static int
+slab_take(struct kmem_cache *c, void **objs, int n)
+{
+  struct slab *s;
+  int got = 0;
+
+  while(got < n){
+    if((s = c->partial) != 0){
+      list_remove(&c->partial, s);
+    } else if((s = c->empty) != 0){
+      list_remove(&c->empty, s);
+    } else if((s = slab_grow(c)) == 0){
+      break;
+    }
+    while(got < n && s->freelist){
+      objs[got++] = s->freelist;
+      s->freelist = *(void**)s->freelist;
+      s->inuse++;
+    }
+    if(s->freelist)
+      list_push(&c->partial, s);
+    else
+      list_push(&c->full, s);
+  }
+  return got;
+}
+
+// Return obj to its slab.
+// Caller must hold c->lock.
+static void
+slab_put(struct kmem_cache *c, void *obj)
+{
+  struct slab *s = obj2slab(c, obj);
+
+  if(s->cache != c)
+    panic("kmem_cache_free: wrong cache");
+
+  if(s->freelist == 0)
+    list_remove(&c->full, s);
+  else
+    list_remove(&c->partial, s);
+
+  *(void**)obj = s->freelist;
+  s->freelist = obj;
+  s->inuse--;
+
+  if(s->inuse > 0){
+    list_push(&c->partial, s);
+  } else if(c->empty == 0){
+    list_push(&c->empty, s);
+  } else {
+    c->nslab--;
+    kfree_pages(s, c->order);
+  }
+}
+
+// Allocate one object from cache c.
+// Returns 0 if memory cannot be allocated.
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n > 0){
+    m->hits++;
+  } else {
+    m->misses++;
+    acquire(&c->lock);
+    m->n = slab_take(c, m->objs, MAGSIZE/2);
+    release(&c->lock);
+  }
+  if(m->n > 0)
+    obj = m->objs[--m->n];
+  if(obj)
+    __sync_fetch_and_add(&c->nalloc, 1);
+  pop_off();
+  return obj;
+}
+
+// Free an object allocated from cache c.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slab_put(c, m->objs[--m->n]);
+    release(&c->lock);
+  }
+  m->objs[m->n++] = obj;
+  __sync_fetch_and_sub(&c->nalloc, 1);
+  pop_off();
+}
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+  for(int i = 0; i < NELEM(kmalloc_caches); i++){
+    snprintf(kmalloc_names[i], sizeof(kmalloc_names[i]), "kmalloc-%d",
+             KMALLOC_MIN << i);
+    kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i], KMALLOC_MIN << i);
+  }
+}
+
+// Allocate n bytes of kernel memory. Requests larger than
+// KMALLOC_MAX get a whole page. Returns 0 on failure.
+void *
+kmalloc(uint n)
+{
+  int i;
+
+  if(n > PGSIZE)
+    return 0;
+  if(n > KMALLOC_MAX)
+    return kalloc();
+  for(i = 0; (KMALLOC_MIN << i) < n; i++)
+    ;
+  return kmem_cache_alloc(kmalloc_caches[i]);
+}
+
+// Free memory returned by kmalloc(). Slab objects never
+// start on a page boundary, since the slab header does,
+// and the kmalloc caches all use one-page slabs, so the
+// header is at the start of the object's page.
+void
+kmfree(void *p)
+{
+  struct slab *s;
+
+  if(((uint64)p % PGSIZE) == 0){
+    kfree(p);
+    return;
+  }
+  s = (struct slab *)PGROUNDDOWN((uint64)p);
+  if(s->cache < slabs.caches || s->cache >= &slabs.caches[slabs.n] ||
+     s->cache->order != 0)
+    panic("kmfree");
+  kmem_cache_free(s->cache, p);
+}
+
+// Report each cache's objects, slabs and magazine hit rate.
+int
+statsslab(char *buf, int sz)
+{
+  struct kmem_cache *c;
+  uint hits, misses;
+  int n, i;
+
+  n = snprintf(buf, sz, "--- slab caches: name size objs slabs hit%%\n");
+  for(c = slabs.caches; c < &slabs.caches[slabs.n]; c++){
+    hits = misses = 0;
+    for(i = 0; i < NCPU; i++){
+      hits += c->mag[i].hits;
+      misses += c->mag[i].misses;
+    }
+    if(hits + misses == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "%s %d %d %d %d\n", c->name, c->size,
+                  c->nalloc, c->nslab, (int)((uint64)hits * 100 / (hits + misses)));
+  }
+  return n;
+}
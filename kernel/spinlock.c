@@ -8,12 +8,38 @@
 #include "proc.h"
 #include "defs.h"
 
+#define NLOCK 500
+
+// every lock initialized by initlock(), for statslock().
+static struct spinlock *locks[NLOCK];
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->n = 0;
+  lk->nts = 0;
+
+  for(int i = 0; i < NLOCK; i++){
+    if(__sync_bool_compare_and_swap(&locks[i], 0, lk))
+      return;
+  }
+  // out of slots: the lock works, it just isn't reported.
+}
+
+// Forget a lock that lives in memory about to be freed,
+// so statslock() doesn't look at it.
+void
+freelock(struct spinlock *lk)
+{
+  for(int i = 0; i < NLOCK; i++){
+    if(locks[i] == lk){
+      locks[i] = 0;
+      return;
+    }
+  }
 }
 
 // Acquire the lock.
@@ -21,6 +47,8 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint nts = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
@@ -30,7 +58,7 @@ acquire(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    nts++;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +68,10 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  // We hold the lock, so plain increments are safe.
+  lk->n++;
+  lk->nts += nts;
 }
 
 // Release the lock.
@@ -108,3 +140,59 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// May this cpu sleep? Not while it holds a spinlock.
+int
+cansleep(void)
+{
+  int r;
+
+  push_off();
+  r = mycpu()->noff == 1;
+  pop_off();
+  return r;
+}
+
+// Print the most contended locks, and the total number of
+// test-and-set spins for all locks, into buf.
+// Returns the number of characters written.
+int
+statslock(char *buf, int sz)
+{
+  struct spinlock *top[5];
+  int i, j, n;
+  uint64 tot = 0;
+
+  memset(top, 0, sizeof(top));
+  for(i = 0; i < NLOCK; i++){
+    struct spinlock *lk = locks[i];
+    if(lk == 0)
+      continue;
+    tot += lk->nts;
+    if(lk->nts == 0)
+      continue;
+    for(j = 0; j < NELEM(top); j++){
+      if(top[j] == 0 || lk->nts > top[j]->nts){
+        memmove(&top[j+1], &top[j], (NELEM(top)-j-1) * sizeof(top[0]));
+        top[j] = lk;
+        break;
+      }
+    }
+  }
+
+  n = snprintf(buf, sz, "--- lock kmem/bcache stats\n");
+  for(i = 0; i < NLOCK; i++){
+    struct spinlock *lk = locks[i];
+    if(lk == 0)
+      continue;
+    if(strncmp(lk->name, "kmem", 4) == 0 || strncmp(lk->name, "bcache", 6) == 0)
+      n += snprintf(buf+n, sz-n, "lock: %s: #test-and-set %d #acquire() %d\n",
+                    lk->name, lk->nts, lk->n);
+  }
+  n += snprintf(buf+n, sz-n, "--- top 5 contended locks:\n");
+  for(j = 0; j < NELEM(top) && top[j]; j++)
+    n += snprintf(buf+n, sz-n, "lock: %s: #test-and-set %d #acquire() %d\n",
+                  top[j]->name, top[j]->nts, top[j]->n);
+  n += snprintf(buf+n, sz-n, "tot= %d\n", (int)tot);
+  return n;
+}
@@ -0,0 +1,113 @@
+//
+// formatted output into a buffer -- snprintf.
+//
+
+#include <stdarg.h>
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "defs.h"
+
+static char digits[] = "0123456789abcdef";
+
+static int
+sputc(char *s, char c)
+{
+  *s = c;
+  return 1;
+}
+
+static int
+sprintint(char *s, int xx, int base, int sign)
+{
+  char buf[16];
+  int i, n;
+  uint x;
+
+  if(sign && (sign = xx < 0))
+    x = -xx;
+  else
+    x = xx;
+
+  i = 0;
+  do {
+    buf[i++] = digits[x % base];
+  } while((x /= base) != 0);
+
+  if(sign)
+    buf[i++] = '-';
+
+  n = 0;
+  while(--i >= 0)
+    n += sputc(s+n, buf[i]);
+  return n;
+}
+
+// Print to the buffer buf of size sz, always NUL-terminated.
+// Only understands %d, %x, %p, %s, like printf.
+// Returns the number of characters written, not including the NUL.
+int
+snprintf(char *buf, int sz, char *fmt, ...)
+{
+  va_list ap;
+  int i, c;
+  int off = 0;
+  char tmp[32];
+  char *s;
+  int n;
+
+  if(fmt == 0)
+    panic("null fmt");
+  if(sz <= 0)
+    return 0;
+
+  va_start(ap, fmt);
+  for(i = 0; (c = fmt[i] & 0xff) != 0 && off < sz - 1; i++){
+    if(c != '%'){
+      off += sputc(buf+off, c);
+      continue;
+    }
+    c = fmt[++i] & 0xff;
+    if(c == 0)
+      break;
+    n = 0;
+    s = tmp;
+    switch(c){
+    case 'd':
+      n = sprintint(tmp, va_arg(ap, int), 10, 1);
+      break;
+    case 'x':
+      n = sprintint(tmp, va_arg(ap, int), 16, 1);
+      break;
+    case 'p': {
+      uint64 x = va_arg(ap, uint64);
+      n += sputc(tmp+n, '0');
+      n += sputc(tmp+n, 'x');
+      for(int j = 0; j < (sizeof(uint64) * 2); j++, x <<= 4)
+        n += sputc(tmp+n, digits[x >> (sizeof(uint64) * 8 - 4)]);
+      break;
+    }
+    case 's':
+      if((s = va_arg(ap, char*)) == 0)
+        s = "(null)";
+      n = strlen(s);
+      break;
+    case '%':
+      n = sputc(tmp, '%');
+      break;
+    default:
+      // Print unknown % sequence to draw attention.
+      n += sputc(tmp+n, '%');
+      n += sputc(tmp+n, c);
+      break;
+    }
+    if(n > sz - 1 - off)
+      n = sz - 1 - off;
+    memmove(buf+off, s, n);
+    off += n;
+  }
+  va_end(ap);
+  buf[off] = 0;
+  return off;
+}
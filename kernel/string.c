@@ -1,13 +1,47 @@
 #include "types.h"
 
+// memset, memcmp and memmove work a 64-bit word at a time.
+// RISC-V traps on misaligned loads and stores, so words are
+// only loaded and stored at 8-byte aligned addresses; the
+// head up to alignment and the tail go a byte at a time.
+// memmove forwards between pointers of different alignment
+// loads aligned source words and shifts each word it stores
+// together from two of them. strnlen looks for the NUL a word
+// at a time.
+
+#define WORDALIGNED(p)  (((uint64)(p) & 7) == 0)
+
+// does word w have a zero byte?
+#define HASZERO(w)  (((w) - 0x0101010101010101UL) & ~(w) & 0x8080808080808080UL)
+
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 *wdst, w;
+
+  while(n > 0 && !WORDALIGNED(cdst)){
+    *cdst++ = c;
+    n--;
   }
+  if(n >= 8){
+    w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    wdst = (uint64 *) cdst;
+    for(; n >= 32; n -= 32, wdst += 4){
+      wdst[0] = w;
+      wdst[1] = w;
+      wdst[2] = w;
+      wdst[3] = w;
+    }
+    for(; n >= 8; n -= 8)
+      *wdst++ = w;
+    cdst = (char *) wdst;
+  }
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -18,6 +52,16 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  if((((uint64)s1 ^ (uint64)s2) & 7) == 0){
+    while(n > 0 && !WORDALIGNED(s1)){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, n--;
+    }
+    // skip equal words; the bytes below find the first difference.
+    while(n >= 8 && *(uint64*)s1 == *(uint64*)s2)
+      s1 += 8, s2 += 8, n -= 8;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -32,20 +76,81 @@ memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  const uint64 *ws;
+  uint64 *wd, lo, hi;
+  int words, sh;
 
   if(n == 0)
     return dst;
   
   s = src;
   d = dst;
+  words = (((uint64)s ^ (uint64)d) & 7) == 0;
   if(s < d && s + n > d){
+    // overlapping, so copy backwards.
     s += n;
     d += n;
+    if(words){
+      while(n > 0 && !WORDALIGNED(d)){
+        *--d = *--s;
+        n--;
+      }
+      ws = (const uint64 *) s;
+      wd = (uint64 *) d;
+      for(; n >= 32; n -= 32){
+        wd -= 4, ws -= 4;
+        wd[3] = ws[3];
+        wd[2] = ws[2];
+        wd[1] = ws[1];
+        wd[0] = ws[0];
+      }
+      for(; n >= 8; n -= 8)
+        *--wd = *--ws;
+      s = (const char *) ws;
+      d = (char *) wd;
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    if(words){
+      while(n > 0 && !WORDALIGNED(d)){
+        *d++ = *s++;
+        n--;
+      }
+      ws = (const uint64 *) s;
+      wd = (uint64 *) d;
+      for(; n >= 32; n -= 32, wd += 4, ws += 4){
+        wd[0] = ws[0];
+        wd[1] = ws[1];
+        wd[2] = ws[2];
+        wd[3] = ws[3];
+      }
+      for(; n >= 8; n -= 8)
+        *wd++ = *ws++;
+      s = (const char *) ws;
+      d = (char *) wd;
+    } else if(n >= 32){
+      while(!WORDALIGNED(d)){
+        *d++ = *s++;
+        n--;
+      }
+      // s is not aligned. each aligned word of s holds a byte
+      // that is copied, so reading it whole stays in bounds.
+      sh = ((uint64)s & 7) * 8;
+      ws = (const uint64 *) ((uint64)s & ~7L);
+      wd = (uint64 *) d;
+      lo = *ws++;
+      for(; n >= 8; n -= 8){
+        hi = *ws++;
+        *wd++ = (lo >> sh) | (hi << (64 - sh));
+        lo = hi;
+      }
+      s += (char *) wd - d;
+      d = (char *) wd;
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
@@ -95,6 +200,25 @@ safestrcpy(char *s, const char *t, int n)
   return os;
 }
 
+// The length of s, or n if none of its first n bytes is NUL.
+uint
+strnlen(const char *s, uint n)
+{
+  const char *p = s;
+  const uint64 *w;
+
+  while(n > 0 && !WORDALIGNED(p)){
+    if(*p == 0)
+      return p - s;
+    p++, n--;
+  }
+  for(w = (const uint64 *) p; n >= 8 && !HASZERO(*w); w++)
+    n -= 8;
+  for(p = (const char *) w; n > 0 && *p; p++)
+    n--;
+  return p - s;
+}
+
 int
 strlen(const char *s)
 {
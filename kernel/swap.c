@@ -0,0 +1,203 @@
+// Swap: when memory runs out, cold user pages are written
+// to the swap area that mkfs lays out past the file system,
+// and read back in when they are next touched.
+//
+// The swap area is divided into slots of one page each.
+// reclaim() goes round the processes that aren't running,
+// like the hand of a clock, and has uvmevict() in vm.c look
+// through each one's page table: a page whose accessed bit
+// is set gets the bit cleared, and a second chance; one that
+// hasn't been touched since is taken out of the page table,
+// its PTE left holding the number of a slot, marked
+// PTE_SWAP, and the page is written to the slot and freed.
+// A fault on the PTE reads the page back (see uvmfault()).
+//
+// fork() copies a swapped-out PTE, so a slot, like a page,
+// has a count of the PTEs that refer to it.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "buf.h"
+#include "defs.h"
+
+#define SLOTBLOCKS (PGSIZE / BSIZE)      // blocks per slot
+#define NSLOT      (SWAPSIZE / SLOTBLOCKS)
+#define RECLAIMN   16                    // pages reclaim() frees at a time
+#define NSWEEP     8                     // times reclaim() may go round
+
+extern struct proc proc[NPROC];
+extern struct superblock sb;
+
+static struct {
+  struct spinlock lock;
+  uchar ref[NSLOT];              // PTEs that refer to each slot
+  uchar busy[NSLOT];             // being written out
+  int hand;                      // next process for reclaim()
+  uint nused;
+  uint outs;
+  uint ins;
+
+  // swapin() waits for busy slots under waitlock, not lock:
+  // reclaim() takes lock holding a p->lock, which sleep()'s
+  // wait-queue lock must never wait behind.
+  struct spinlock waitlock;
+
+  // swap I/O bypasses the buffer cache, one page at a time.
+  struct sleeplock io;
+  struct buf buf[SLOTBLOCKS];
+} swap;
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  initlock(&swap.waitlock, "swapwait");
+  initsleeplock(&swap.io, "swapio");
+}
+
+// Slots in the swap area. There are none until fsinit()
+// has read the superblock.
+static int
+nslot(void)
+{
+  uint n = sb.nswap / SLOTBLOCKS;
+
+  return n < NSLOT ? n : NSLOT;
+}
+
+// Allocate a slot for a page about to be written out. The
+// slot is busy until reclaim() has written it.
+// Returns -1 if the swap area is full.
+int
+swapalloc(void)
+{
+  int i, n = nslot();
+
+  acquire(&swap.lock);
+  for(i = 0; i < n; i++){
+    if(swap.ref[i] == 0 && !swap.busy[i]){
+      swap.ref[i] = 1;
+      swap.busy[i] = 1;
+      swap.nused++;
+      release(&swap.lock);
+      return i;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Another PTE refers to slot.
+void
+swapdup(int slot)
+{
+  acquire(&swap.lock);
+  if(swap.ref[slot] < 1)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// A PTE no longer refers to slot. The last one frees it,
+// once any write to it is done.
+void
+swapfree(int slot)
+{
+  acquire(&swap.lock);
+  if(swap.ref[slot] < 1)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0 && !swap.busy[slot])
+    swap.nused--;
+  release(&swap.lock);
+}
+
+// Read or write the page at pa from or to slot.
+static void
+swaprw(int slot, char *pa, int write)
+{
+  struct buf *b;
+  int i;
+
+  acquiresleep(&swap.io);
+  for(i = 0; i < SLOTBLOCKS; i++){
+    b = &swap.buf[i];
+    b->blockno = sb.swapstart + slot*SLOTBLOCKS + i;
+    if(write)
+      memmove(b->data, pa + i*BSIZE, BSIZE);
+    virtio_disk_rw(b, write);
+    if(!write)
+      memmove(pa + i*BSIZE, b->data, BSIZE);
+  }
+  releasesleep(&swap.io);
+}
+
+// Read the page in slot into pa, waiting for it to be
+// written out first if it is still on its way.
+// The caller still holds its reference to slot.
+void
+swapin(int slot, void *pa)
+{
+  acquire(&swap.waitlock);
+  while(swap.busy[slot])
+    sleep(&swap.busy[slot], &swap.waitlock);
+  release(&swap.waitlock);
+  __sync_fetch_and_add(&swap.ins, 1);
+  swaprw(slot, pa, 0);
+}
+
+// Free some memory by swapping out up to RECLAIMN cold
+// pages of processes that aren't running, or of the
+// current process, leaving those with threads be: another
+// thread could be copying to a page as it goes. Sleeps, so
+// the caller must not hold a spinlock. Returns the number
+// of pages freed.
+int
+reclaim(void)
+{
+  struct proc *p;
+  uint64 pa[RECLAIMN];
+  int slot[RECLAIMN];
+  int i, n = 0, k;
+
+  // a page whose accessed bit is set is passed over the
+  // first time round, so it may take more than one sweep.
+  for(k = 0; k < NSWEEP*NPROC && n < RECLAIMN; k++){
+    acquire(&swap.lock);
+    p = &proc[swap.hand];
+    swap.hand = (swap.hand + 1) % NPROC;
+    release(&swap.lock);
+
+    acquire(&p->lock);
+    if(p->pagetable && p->mm->ref == 1 &&
+       (p == myproc() || p->state == RUNNABLE || p->state == SLEEPING))
+      n += uvmevict(p, pa + n, slot + n, RECLAIMN - n);
+    release(&p->lock);
+  }
+
+  for(i = 0; i < n; i++){
+    swaprw(slot[i], (char*)pa[i], 1);
+    kfree((void*)pa[i]);
+    acquire(&swap.lock);
+    acquire(&swap.waitlock);
+    swap.busy[slot[i]] = 0;
+    release(&swap.waitlock);
+    if(swap.ref[slot[i]] == 0)
+      swap.nused--;   // unmapped while being written
+    swap.outs++;
+    release(&swap.lock);
+    wakeup(&swap.busy[slot[i]]);
+  }
+  return n;
+}
+
+int
+statsswap(char *buf, int sz)
+{
+  return snprintf(buf, sz, "--- swap: slots %d/%d out %d in %d\n",
+                  swap.nused, nslot(), swap.outs, swap.ins);
+}
@@ -12,7 +12,7 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz)
+  if(addr >= p->mm->sz || addr+sizeof(uint64) > p->mm->sz)
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -104,6 +104,14 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_spawn(void);
 
 //函数指针数组
 static uint64 (*syscalls[])(void) = {
@@ -128,6 +136,14 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_getrusage] sys_getrusage,
+[SYS_setpriority] sys_setpriority,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_clone]   sys_clone,
+[SYS_futex]   sys_futex,
+[SYS_spawn]   sys_spawn,
 };
 
 void
@@ -139,6 +155,9 @@ syscall(void)
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     p->trapframe->a0 = syscalls[num]();
+    // let reclaim() have the pages uvmtouch() kept from it.
+    p->pinva = p->pinend = 0;
+    cowdrain(p);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -20,3 +20,11 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_mmap   22
+#define SYS_munmap 23
+#define SYS_getrusage 24
+#define SYS_setpriority 25
+#define SYS_setaffinity 26
+#define SYS_clone  27
+#define SYS_futex  28
+#define SYS_spawn  29
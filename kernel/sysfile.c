@@ -8,6 +8,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
 #include "stat.h"
 #include "spinlock.h"
 #include "proc.h"
@@ -17,21 +18,30 @@
 #include "fcntl.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return both the descriptor and the corresponding struct file,
+// with a reference of its own that the caller must fileclose(): another
+// thread may close the descriptor meanwhile.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
   int fd;
   struct file *f;
+  struct files *fs = myproc()->files;
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE)
     return -1;
+  acquire(&fs->lock);
+  if((f=fs->ofile[fd]) == 0){
+    release(&fs->lock);
+    return -1;
+  }
+  filedup(f);
+  release(&fs->lock);
   if(pfd)
     *pfd = fd;
-  if(pf)
-    *pf = f;
+  *pf = f;
   return 0;
 }
 
@@ -41,17 +51,37 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct files *fs = myproc()->files;
 
+  acquire(&fs->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(fs->ofile[fd] == 0){
+      fs->ofile[fd] = f;
+      release(&fs->lock);
       return fd;
     }
   }
+  release(&fs->lock);
   return -1;
 }
 
+// Undo fdalloc(), unless another thread has closed fd
+// already.
+static void
+fdfree(int fd, struct file *f)
+{
+  struct files *fs = myproc()->files;
+
+  acquire(&fs->lock);
+  if(fs->ofile[fd] != f){
+    release(&fs->lock);
+    return;
+  }
+  fs->ofile[fd] = 0;
+  release(&fs->lock);
+  fileclose(f);
+}
+
 uint64
 sys_dup(void)
 {
@@ -60,9 +90,10 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -73,9 +104,11 @@ sys_read(void)
   int n;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  n = fileread(f, p, n);
+  fileclose(f);
+  return n;
 }
 
 uint64
@@ -85,10 +118,12 @@ sys_write(void)
   int n;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  n = filewrite(f, p, n);
+  fileclose(f);
+  return n;
 }
 
 uint64
@@ -96,10 +131,19 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct files *fs = myproc()->files;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0 || fd < 0 || fd >= NOFILE)
     return -1;
-  myproc()->ofile[fd] = 0;
+  acquire(&fs->lock);
+  if((f = fs->ofile[fd]) == 0){
+    release(&fs->lock);
+    return -1;
+  }
+  fs->ofile[fd] = 0;
+  release(&fs->lock);
+  // a read or write in another thread may hold f a while
+  // longer (see argfd()).
   fileclose(f);
   return 0;
 }
@@ -109,10 +153,13 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
 
-  if(argfd(0, 0, &f) < 0 || argaddr(1, &st) < 0)
+  if(argaddr(1, &st) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -391,8 +438,8 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
-  struct proc *p = myproc();
+  struct inode *ip, *old;
+  struct files *fs = myproc()->files;
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
@@ -406,25 +453,33 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  acquire(&fs->lock);
+  old = fs->cwd;
+  fs->cwd = ip;
+  release(&fs->lock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Fetch the user argv array at uargv into argv, with the
+// strings packed into one page, which is returned in *bufp
+// for the caller to kfree(): exec copies them onto a
+// one-page user stack, so they must fit in one anyway.
+// Returns 0, or -1 having freed the page.
+static int
+fetchargv(uint64 uargv, char **argv, char **bufp)
 {
-  char path[MAXPATH], *argv[MAXARG];
-  int i;
-  uint64 uargv, uarg;
+  char *buf;
+  int i, n, off;
+  uint64 uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+  if((buf = kalloc()) == 0)
     return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
+  off = 0;
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
+    if(i >= MAXARG){
       goto bad;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
@@ -434,24 +489,63 @@ sys_exec(void)
       argv[i] = 0;
       break;
     }
-    argv[i] = kalloc();
-    if(argv[i] == 0)
+    if(off >= PGSIZE)
       goto bad;
-    if(fetchstr(uarg, argv[i], PGSIZE) < 0)
+    argv[i] = buf + off;
+    if((n = fetchstr(uarg, argv[i], PGSIZE - off)) < 0)
       goto bad;
+    off += n + 1;
   }
+  *bufp = buf;
+  return 0;
+
+ bad:
+  kfree(buf);
+  return -1;
+}
 
-  int ret = exec(path, argv);
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG], *buf;
+  uint64 uargv;
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv, &buf) < 0)
+    return -1;
 
+  int ret = exec(myproc(), path, argv);
+
+  kfree(buf);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// Start the program at path in a new child process, without
+// copying this one (see spawn()). fds, if not 0, points to
+// three fds to be the child's 0, 1 and 2.
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG], *buf;
+  uint64 uargv, ufds;
+  int fds[3], *fdp = 0;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 || argaddr(2, &ufds) < 0)
+    return -1;
+  if(ufds){
+    if(copyin(myproc()->pagetable, (char*)fds, ufds, sizeof(fds)) < 0)
+      return -1;
+    fdp = fds;
+  }
+  if(fetchargv(uargv, argv, &buf) < 0)
+    return -1;
+
+  int ret = spawn(path, argv, fdp);
+
+  kfree(buf);
+  return ret;
 }
 
 uint64
@@ -469,18 +563,59 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
-    fileclose(rf);
+      fdfree(fd0, rf);
+    else
+      fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
-    fileclose(rf);
-    fileclose(wf);
+    fdfree(fd0, rf);
+    fdfree(fd1, wf);
     return -1;
   }
   return 0;
 }
+
+// Map a file, or anonymous memory, into the process.
+// The address hint is ignored: mmap() picks the address.
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len;
+  int prot, flags, fd, off;
+  struct file *f = 0;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(4, &fd) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len == 0 || len > USERTOP || off < 0 || (off % PGSIZE) != 0)
+    return -1;
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return -1;
+
+  if((flags & MAP_ANONYMOUS) == 0){
+    if(argfd(4, 0, &f) < 0)
+      return -1;
+    if(f->type != FD_INODE || !f->readable ||
+       ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)){
+      fileclose(f);
+      return -1;
+    }
+  }
+  addr = mmap(len, prot, flags, f, off);
+  if(f)
+    fileclose(f);
+  return addr;
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "rusage.h"
 
 uint64
 sys_exit(void)
@@ -46,7 +47,7 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
+  addr = myproc()->mm->sz;
   if(growproc(n) < 0)
     return -1;
   return addr;
@@ -67,7 +68,9 @@ sys_sleep(void)
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    // nothing else sleeps on ticks0, so only the
+    // timeout wakes us.
+    sleeptimeout(&ticks0, &tickslock, n - (ticks - ticks0));
   }
   release(&tickslock);
   return 0;
@@ -95,3 +98,63 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+uint64
+sys_getrusage(void)
+{
+  int pid;
+  uint64 addr;
+  struct rusage ru;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if((pid = getrusage(pid, &ru)) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char *)&ru, sizeof(ru)) < 0)
+    return -1;
+  return pid;
+}
+
+uint64
+sys_setpriority(void)
+{
+  int pid, nice;
+
+  if(argint(0, &pid) < 0 || argint(1, &nice) < 0)
+    return -1;
+  return setpriority(pid, nice);
+}
+
+uint64
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+// Start a thread at fn(arg), with the stack whose top is
+// stack (see clone()).
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+// Wait for, or wake waiters on, the int at addr (see futex()).
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  return futex(addr, op, val);
+}
@@ -0,0 +1,183 @@
+// Timeouts, kept in a hierarchical timer wheel.
+//
+// Level 0 of the wheel has a slot for each of the next
+// WHEELSIZE ticks, and each slot of level l a span of
+// WHEELSIZE^l ticks, so that the NLEVEL levels reach
+// MAXDELAY ticks ahead. A timer goes in the slot of the
+// lowest level that reaches its tick. On each tick,
+// timertick() runs the timers in the level 0 slot for the
+// tick; and each time a level comes round to its first
+// slot, it moves the timers in the next slot of the level
+// above down to where they now belong. So adding, deleting
+// and running a timer take time independent of how many
+// are pending, and only timers that are due are run.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "defs.h"
+
+#define WHEELBITS  6
+#define WHEELSIZE  (1 << WHEELBITS)
+#define NLEVEL     4
+#define MAXDELAY   ((1U << (NLEVEL*WHEELBITS)) - 1)
+#define SLOT(t, l) (((t) >> ((l)*WHEELBITS)) & (WHEELSIZE-1))
+
+static struct {
+  struct spinlock lock;
+  uint next;                               // next tick to run timers for
+  struct timer *slot[NLEVEL][WHEELSIZE];
+  uint pending;
+  uint fired;
+  uint moved;                              // from one level to a lower one
+} wheel;
+
+void
+timerwheelinit(void)
+{
+  initlock(&wheel.lock, "timers");
+}
+
+// Put t in the slot for t->expires.
+// Caller holds wheel.lock.
+static void
+place(struct timer *t)
+{
+  uint delta = t->expires - wheel.next;
+  struct timer **pp;
+  int l;
+
+  for(l = 0; l < NLEVEL-1 && delta >= (1U << ((l+1)*WHEELBITS)); l++)
+    ;
+  pp = &wheel.slot[l][SLOT(t->expires, l)];
+  t->next = *pp;
+  if(t->next)
+    t->next->pprev = &t->next;
+  *pp = t;
+  t->pprev = pp;
+}
+
+// Take t out of its slot.
+// Caller holds wheel.lock.
+static void
+unlink(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->pprev = 0;
+}
+
+// Arrange for fn(arg) to be called n ticks from now, or
+// MAXDELAY ticks if n is more than that. t must not be
+// pending already.
+void
+timeradd(struct timer *t, uint n, void (*fn)(void*), void *arg)
+{
+  if(n == 0)
+    n = 1;
+  if(n > MAXDELAY)
+    n = MAXDELAY;
+  t->fn = fn;
+  t->arg = arg;
+  acquire(&wheel.lock);
+  t->expires = wheel.next + n - 1;
+  place(t);
+  wheel.pending++;
+  release(&wheel.lock);
+}
+
+// Cancel t. Once timerdel() returns, t->fn is not running
+// and won't be called. Returns 1 if t was still pending,
+// 0 if it had gone off.
+int
+timerdel(struct timer *t)
+{
+  int pending;
+
+  acquire(&wheel.lock);
+  if((pending = t->pprev != 0) != 0){
+    unlink(t);
+    wheel.pending--;
+  }
+  release(&wheel.lock);
+  return pending;
+}
+
+// Move the timers in level l's slot for wheel.next down.
+// Caller holds wheel.lock.
+static void
+cascade(int l)
+{
+  struct timer *t, *next;
+  struct timer **pp = &wheel.slot[l][SLOT(wheel.next, l)];
+
+  for(t = *pp, *pp = 0; t; t = next){
+    next = t->next;
+    place(t);
+    wheel.moved++;
+  }
+}
+
+// Set *tick to when the next pending timer is due, or a
+// little before if it is on an upper level, where only its
+// slot is known. Returns 0 if no timer is pending.
+int
+timernext(uint *tick)
+{
+  uint t, first = 0;
+  int l, k, found = 0;
+
+  acquire(&wheel.lock);
+  for(l = 0; l < NLEVEL; l++){
+    // a level 0 slot is due at its tick; an upper slot
+    // is moved down when its span starts. once the level
+    // has moved its current slot down, the slot holds only
+    // timers a whole turn of the level ahead.
+    k = (wheel.next & ((1U << (l*WHEELBITS)) - 1)) ? 1 : 0;
+    for(; k <= WHEELSIZE; k++){
+      t = ((wheel.next >> (l*WHEELBITS)) + k) << (l*WHEELBITS);
+      if(wheel.slot[l][SLOT(t, l)]){
+        if(!found || (int)(t - first) < 0)
+          first = t;
+        found = 1;
+        break;
+      }
+    }
+  }
+  release(&wheel.lock);
+  *tick = first;
+  return found;
+}
+
+// Called by clockintr() when the tick changes: run the
+// timers due by tick now.
+void
+timertick(uint now)
+{
+  struct timer *t;
+  int l;
+
+  acquire(&wheel.lock);
+  while((int)(now - wheel.next) >= 0){
+    for(l = 1; l < NLEVEL && SLOT(wheel.next, l-1) == 0; l++)
+      cascade(l);
+    while((t = wheel.slot[0][SLOT(wheel.next, 0)]) != 0){
+      unlink(t);
+      wheel.pending--;
+      wheel.fired++;
+      t->fn(t->arg);
+    }
+    wheel.next++;
+  }
+  release(&wheel.lock);
+}
+
+int
+statstimer(char *buf, int sz)
+{
+  return snprintf(buf, sz, "--- timers: pending %d fired %d moved %d\n",
+                  wheel.pending, wheel.fired, wheel.moved);
+}
@@ -0,0 +1,11 @@
+// A timeout: once its ticks have passed, the clock interrupt
+// calls fn(arg), holding the timer wheel's lock, so fn must
+// not sleep, nor take a lock held by anyone calling
+// timeradd() or timerdel().
+struct timer {
+  uint expires;             // tick it goes off at
+  void (*fn)(void*);
+  void *arg;
+  struct timer *next;       // in its slot of the wheel
+  struct timer **pprev;     // what points to it, or 0 if not pending
+};
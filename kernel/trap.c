@@ -10,6 +10,7 @@ struct spinlock tickslock;
 uint ticks;
 
 extern char trampoline[], uservec[], userret[];
+extern struct proc proc[NPROC];
 
 // in kernelvec.S, calls kerneltrap().
 void kernelvec();
@@ -67,6 +68,10 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            uvmfault(p, r_stval(), r_scause() == 12 ? PTE_X :
+                                   r_scause() == 13 ? PTE_R : PTE_W) == 0){
+    // page fault on a lazily-loaded or copy-on-write page.
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -76,9 +81,10 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
+  // give up the CPU if this is a timer interrupt
+  // and p's time is up.
   if(which_dev == 2)
-    yield();
+    schedtick();
 
   usertrapret();
 }
@@ -119,13 +125,13 @@ usertrapret(void)
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = uvmsatp(p);
 
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(TRAPFRAME(p - proc), satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -149,9 +155,10 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
+  // give up the CPU if this is a timer interrupt
+  // and the process's time is up.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+    schedtick();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -162,10 +169,22 @@ kerneltrap()
 void
 clockintr()
 {
+  uint now, then;
+
+  // every hart's timer interrupts, but an idle hart's stop
+  // (see cpuidle()), so ticks follows the time CSR rather
+  // than counting interrupts.
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  then = ticks;
+  now = r_time() / TICKCYCLES;
+  if((int)(now - then) > 0)
+    ticks = now;
   release(&tickslock);
+  if((int)(now - then) > 0){
+    timertick(now);
+    if(now / BOOST != then / BOOST)
+      schedboost();
+  }
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -204,14 +223,14 @@ devintr()
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip, first, so that a cpuwake()
+    // from here on interrupts again.
     w_sip(r_sip() & ~2);
 
+    tlbsync();
+    clockintr();
+
     return 2;
   } else {
     return 0;
@@ -3,8 +3,14 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "rusage.h"
 
 /*
  * the kernel's page table.
@@ -15,14 +21,61 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// a page of zeros, mapped copy-on-write in place of untouched
+// anonymous memory that is read before it is written. It
+// holds a reference of its own, so it is never freed.
+static char *zeropage;
+
+static pte_t *walklevel(pagetable_t, uint64, int, int);
+
+// RISC-V address-space IDs. Each address space runs with an
+// ASID of its own, so that TLB entries of different
+// processes, and of the kernel, which uses ASID 0, can live
+// side by side. ASIDs are handed out in order; when they run
+// out, a new generation starts, every address space gets a
+// new ASID the next time one of its threads returns to user
+// space, and each hart flushes its whole TLB once before
+// using the new ones.
+static struct {
+  struct spinlock lock;
+  uint n;       // ASIDs the hardware has, including 0
+  uint next;    // next to hand out
+  uint gen;     // current generation, from 1
+} asids;
+
+// TLB flushes, for the statistics device.
+static struct {
+  uint all;      // whole TLB
+  uint asid;     // one address space
+  uint page;     // a few pages
+  uint rollover; // ASID generations
+  uint shootdown; // tlbshootdown()s
+} tlbstats;
+
+#define TLBFLUSHMAX  32  // flush more pages than this at once
+#define UNMAPBATCH   32  // pages uvmunmapsync() frees per shootdown
+
+// a swapped-out PTE holds a swap slot where the PPN goes.
+#define PTE2SLOT(pte) ((int)((pte) >> 10))
+#define SLOT2PTE(slot) (((uint64)(slot)) << 10)
+#define SWAPPED(pte) (((pte) & (PTE_V|PTE_SWAP)) == PTE_SWAP)
+
+#define EVICTSCAN  8192  // pages uvmevict() looks at per call
+
+// superpage activity, for the statistics device.
+static struct {
+  uint mapped;   // user superpages mapped on a fault
+  uint copied;   // copy-on-write superpages copied whole
+  uint split;    // superpages split into pages
+} superstats;
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  kpgtbl = (pagetable_t) kalloc_zeroed();
 
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -33,10 +86,15 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
+  // CLINT, whose timer compare registers the scheduler
+  // moves to stop and start clock ticks (see cpuidle()).
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
+  // mappages() uses superpages from the first 2MB boundary on.
   kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
@@ -54,6 +112,7 @@ void
 kvminit(void)
 {
   kernel_pagetable = kvmmake();
+  zeropage = kalloc_zeroed();
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -61,8 +120,150 @@ kvminit(void)
 void
 kvminithart()
 {
+  uint64 satp;
+
+  // the ASID bits of satp that the hardware implements
+  // read back as ones.
+  w_satp(MAKE_SATP(kernel_pagetable) | SATP_ASID(0xFFFF));
+  satp = r_satp();
   w_satp(MAKE_SATP(kernel_pagetable));
   sfence_vma();
+
+  if(cpuid() == 0){
+    initlock(&asids.lock, "asid");
+    asids.n = SATP2ASID(satp) + 1;
+    asids.next = 1;
+    asids.gen = 1;
+  }
+}
+
+// Return the satp value with which to run p's user page
+// table, with its ASID, and make sure this hart's TLB holds
+// no stale entries for that ASID. Called by usertrapret()
+// with interrupts off.
+uint64
+uvmsatp(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  struct mm *mm = p->mm;
+  uint gen, bit = 1 << cpuid();
+  uint64 satp;
+
+  if(asids.n <= 1){
+    // no ASIDs: trampoline.S flushes the whole TLB
+    // on every switch.
+    return MAKE_SATP(p->pagetable);
+  }
+
+  acquire(&mm->lock);
+  gen = __atomic_load_n(&asids.gen, __ATOMIC_ACQUIRE);
+  if(mm->asidgen != gen){
+    acquire(&asids.lock);
+    if(asids.next >= asids.n){
+      asids.gen++;
+      asids.next = 1;
+      tlbstats.rollover++;
+    }
+    mm->asid = asids.next++;
+    mm->asidgen = gen = asids.gen;
+    release(&asids.lock);
+    mm->tlbcpus = 0;
+  }
+
+  if(c->asidgen != gen){
+    sfence_vma();
+    c->asidgen = gen;
+    tlbstats.all++;
+  } else if((mm->tlbcpus & bit) == 0){
+    // the page table may have changed since a thread
+    // last ran here, while on another hart.
+    sfence_vma_asid(mm->asid);
+    tlbstats.asid++;
+  }
+  mm->tlbcpus |= bit;
+  satp = MAKE_SATP(mm->pagetable) | SATP_ASID(mm->asid);
+  release(&mm->lock);
+  return satp;
+}
+
+// PTEs for n bytes at va in pagetable have changed. If it is
+// the current process's page table, flush the stale TLB
+// entries on this hart; other harts flush when one of its
+// threads next returns to user space on them (see uvmsatp()),
+// or sooner if tlbshootdown() asks. Caller holds mm->lock.
+static void
+tlbflush(pagetable_t pagetable, uint64 va, uint64 n)
+{
+  struct proc *p = myproc();
+  struct mm *mm;
+  uint64 a;
+  uint bit;
+
+  if(p == 0 || p->pagetable != pagetable || (mm = p->mm)->asidgen == 0)
+    return;
+
+  push_off();
+  bit = 1 << cpuid();
+  if((mm->tlbcpus & bit) == 0){
+    // changed on a hart no thread last ran on in user
+    // space with this ASID; uvmsatp() will flush.
+    mm->tlbcpus = 0;
+  } else if(n > TLBFLUSHMAX*PGSIZE){
+    mm->tlbcpus = bit;
+    sfence_vma_asid(mm->asid);
+    tlbstats.asid++;
+  } else {
+    mm->tlbcpus = bit;
+    for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+      sfence_vma_page(a, mm->asid);
+    tlbstats.page++;
+  }
+  pop_off();
+}
+
+// Make the other harts running threads of mm, whose bits
+// tlbflush() has cleared, flush their TLBs now rather than
+// the next time they return to user space, and wait until
+// they have: before pages that mm no longer maps are used
+// again, or pages it maps copy-on-write are shared.
+// Caller holds no spinlock: the other harts flush on a clock
+// interrupt, which one spinning for a lock it holds never takes.
+void
+tlbshootdown(struct mm *mm)
+{
+  struct cpu *c, *me;
+  struct proc *p;
+
+  if(__atomic_load_n(&mm->ref, __ATOMIC_ACQUIRE) <= 1)
+    return;  // no other threads
+  push_off();
+  me = mycpu();
+  if(me->noff > 1)
+    panic("tlbshootdown");
+  pop_off();
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c != me && (p = c->proc) != 0 && p->mm == mm){
+      __atomic_store_n(&c->tlbreq, 1, __ATOMIC_RELEASE);
+      cpuwake(c);
+    }
+  }
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    while(__atomic_load_n(&c->tlbreq, __ATOMIC_ACQUIRE))
+      ;
+  __sync_fetch_and_add(&tlbstats.shootdown, 1);
+}
+
+// Called on each clock interrupt: flush this hart's TLB
+// if tlbshootdown() has asked.
+void
+tlbsync(void)
+{
+  struct cpu *c = mycpu();
+
+  if(__atomic_load_n(&c->tlbreq, __ATOMIC_ACQUIRE)){
+    sfence_vma();
+    __atomic_store_n(&c->tlbreq, 0, __ATOMIC_RELEASE);
+  }
 }
 
 // Return the address of the PTE in page table pagetable
@@ -77,24 +278,64 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// A level-1 PTE may itself be a leaf, marked PTE_SUPER, that
+// maps a 2MB superpage; walk() returns it for any va within.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, alloc, 0);
+}
+
+// Like walk(), but return the PTE of the given level:
+// 1 for a superpage, 0 for a page.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int leaf)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
+  for(int level = 2; level > leaf; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
-    if(*pte & PTE_V) {
+    if(*pte & PTE_SUPER) {
+      return pte;
+    } else if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(leaf, va)];
+}
+
+// The physical address of the page at va, which *pte maps.
+static uint64
+pteaddr(pte_t *pte, uint64 va)
+{
+  if(*pte & PTE_SUPER)
+    return PTE2PA(*pte) + PGROUNDDOWN(va & (SUPERPGSIZE-1));
+  return PTE2PA(*pte);
+}
+
+// Split the superpage leaf *pte into a page-table page of
+// 512 leaves that map the same memory the same way.
+// Returns 0 on success, -1 if out of memory.
+static int
+demote(pte_t *pte)
+{
+  pagetable_t pt;
+  uint64 pa = PTE2PA(*pte);
+  uint flags = PTE_FLAGS(*pte) & ~PTE_SUPER;
+
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return -1;
+  for(int i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(pt) | PTE_V;
+  __sync_fetch_and_add(&superstats.split, 1);
+  return 0;
 }
 
 // Look up a virtual address, return the physical address,
@@ -116,7 +357,7 @@ walkaddr(pagetable_t pagetable, uint64 va)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
+  pa = pteaddr(pte, va);
   return pa;
 }
 
@@ -132,50 +373,89 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
-// be page-aligned. Returns 0 on success, -1 if walk() couldn't
-// allocate a needed page-table page.
+// be page-aligned. Wherever va and pa are both 2MB-aligned
+// and at least 2MB remain, maps a superpage. Returns 0 on
+// success, -1 if walk() couldn't allocate a needed
+// page-table page.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
-  uint64 a, last;
+  uint64 a, last, sz;
   pte_t *pte;
 
   if(size == 0)
     panic("mappages: size");
   
+  perm &= ~PTE_SUPER;
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
+    if((a % SUPERPGSIZE) == 0 && (pa % SUPERPGSIZE) == 0 &&
+       last - a >= SUPERPGSIZE - PGSIZE){
+      sz = SUPERPGSIZE;
+      pte = walklevel(pagetable, a, 1, 1);
+    } else {
+      sz = PGSIZE;
+      pte = walk(pagetable, a, 1);
+    }
+    if(pte == 0)
       return -1;
     if(*pte & PTE_V)
       panic("mappages: remap");
-    *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
+    *pte = PA2PTE(pa) | perm | (sz == SUPERPGSIZE ? PTE_SUPER : 0) | PTE_V;
+    if(a + sz - PGSIZE == last)
       break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    a += sz;
+    pa += sz;
   }
   return 0;
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never touched, and so
+// never mapped, are skipped. A superpage only partly
+// in the range is split first. A swapped-out page gives
+// up its swap slot.
 // Optionally free the physical memory.
-void
+// Returns 0, or -1 if there was no memory to split a
+// superpage, with only the mappings before it removed.
+int
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end = va + npages*PGSIZE;
   pte_t *pte;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
+  for(a = va; a < end; a += PGSIZE){
+    if((pte = walk(pagetable, a, 0)) == 0){
+      // no page-table page, so nothing is mapped
+      // up to the next 2MB boundary.
+      a = (a | (SUPERPGSIZE - 1)) + 1 - PGSIZE;
+      continue;
+    }
+    if(SWAPPED(*pte)){
+      swapfree(PTE2SLOT(*pte));
+      *pte = 0;
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+      continue;
+    if(*pte & PTE_SUPER){
+      if((a % SUPERPGSIZE) == 0 && end - a >= SUPERPGSIZE){
+        if(do_free)
+          ksuperfree((void*)PTE2PA(*pte));
+        *pte = 0;
+        a += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      if(demote(pte) < 0){
+        tlbflush(pagetable, va, a - va);
+        return -1;
+      }
+      pte = walk(pagetable, a, 0);
+    }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -184,6 +464,84 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     }
     *pte = 0;
   }
+  tlbflush(pagetable, va, npages*PGSIZE);
+  return 0;
+}
+
+// If a superpage maps va, and va isn't the start of it,
+// split it, so that the memory from va on can be unmapped
+// without splitting it then (see growproc()).
+// Returns 0, or -1 if out of memory. Caller holds mm->lock.
+int
+uvmsplit(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if((va % SUPERPGSIZE) == 0 || (pte = walk(pagetable, va, 0)) == 0)
+    return 0;
+  if((*pte & (PTE_V|PTE_SUPER)) != (PTE_V|PTE_SUPER))
+    return 0;
+  return demote(pte);
+}
+
+// Unmap npages of mm's memory starting from va, and free
+// the pages, like uvmunmap(), but when threads share mm, free
+// them only once their harts' TLBs no longer map them (see
+// tlbshootdown()), UNMAPBATCH pages at a time.
+// Returns 0, or -1 if, like uvmunmap(), it couldn't split a
+// superpage. Caller holds no spinlock.
+int
+uvmunmapsync(struct mm *mm, uint64 va, uint64 npages)
+{
+  uint64 pa[UNMAPBATCH], a, next, end = va + npages*PGSIZE;
+  pte_t *pte;
+  int i, n, r = 0;
+
+  for(a = va; a < end && r == 0; a = next){
+    acquire(&mm->lock);
+    if(mm->ref <= 1){
+      r = uvmunmap(mm->pagetable, a, (end - a) / PGSIZE, 1);
+      release(&mm->lock);
+      return r;
+    }
+    // hold on to the pages while the PTEs go.
+    n = 0;
+    for(next = a; next < end && n < UNMAPBATCH; next += PGSIZE){
+      if((pte = walk(mm->pagetable, next, 0)) == 0){
+        next = (next | (SUPERPGSIZE - 1)) + 1 - PGSIZE;
+        continue;
+      }
+      if((*pte & PTE_V) == 0)
+        continue;
+      if(*pte & PTE_SUPER){
+        if((next % SUPERPGSIZE) == 0 && end - next >= SUPERPGSIZE){
+          ksuperdup((void*)PTE2PA(*pte));
+          pa[n++] = PTE2PA(*pte) | 1;
+          next += SUPERPGSIZE - PGSIZE;
+          continue;
+        }
+        if(demote(pte) < 0){
+          r = -1;
+          break;
+        }
+        pte = walk(mm->pagetable, next, 0);
+      }
+      kdup((void*)PTE2PA(*pte));
+      pa[n++] = PTE2PA(*pte);
+    }
+    if(next > end)
+      next = end;
+    uvmunmap(mm->pagetable, a, (next - a) / PGSIZE, 1);
+    release(&mm->lock);
+    tlbshootdown(mm);
+    for(i = 0; i < n; i++){
+      if(pa[i] & 1)
+        ksuperfree((void*)(pa[i] & ~1));
+      else
+        kfree((void*)pa[i]);
+    }
+  }
+  return r;
 }
 
 // create an empty user page table.
@@ -191,12 +549,7 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 pagetable_t
 uvmcreate()
 {
-  pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
-  if(pagetable == 0)
-    return 0;
-  memset(pagetable, 0, PGSIZE);
-  return pagetable;
+  return (pagetable_t) kalloc_zeroed();
 }
 
 // Load the user initcode into address 0 of pagetable,
@@ -209,8 +562,7 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -228,12 +580,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -291,42 +642,661 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
+// Copy the mappings of [start, end) from a parent process's
+// page table into a child's, sharing the physical memory.
+// Unless shared is set, writable pages become read-only
+// and copy-on-write in both parent and child; if it is,
+// parent and child write to the same pages. A swapped-out
+// page stays out, with the child sharing its slot.
+// returns 0 on success, -1 on failure.
+// unmaps any pages mapped into new on failure.
+int
+uvmcopyrange(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int shared)
+{
+  pte_t *pte, *npte;
+  uint64 pa, i;
+  uint flags;
+
+  for(i = start; i < end; i += PGSIZE){
+    if((pte = walk(old, i, 0)) != 0 && SWAPPED(*pte)){
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      swapdup(PTE2SLOT(*pte));
+      *npte = *pte;
+      continue;
+    }
+    if(pte == 0 || (*pte & PTE_V) == 0)
+      continue;  // not touched yet; the child faults it in too
+    if(shared){
+      if((*pte & PTE_COW) && cowfault(pte, 0) < 0)
+        goto err;
+    } else if(*pte & PTE_W){
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+    }
+    pa = PTE2PA(*pte);
+    flags = PTE_FLAGS(*pte);
+    if(*pte & PTE_SUPER){
+      // only heap memory is mapped with superpages, and
+      // the heap is copied from its 2MB-aligned start.
+      if(mappages(new, i, SUPERPGSIZE, pa, flags) != 0)
+        goto err;
+      ksuperdup((void*)pa);
+      i += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
+      goto err;
+    kdup((void*)pa);
+  }
+  tlbflush(old, start, end - start);
+  return 0;
+
+ err:
+  tlbflush(old, start, end - start);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
+  return -1;
+}
+
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Copies the page table, but shares the physical
+// memory copy-on-write.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
-  uint64 pa, i;
+  return uvmcopyrange(old, new, 0, sz, 0);
+}
+
+// Handle a write to a copy-on-write superpage. Like
+// cowfault(), but if no 2MB block is free to copy it to,
+// split it, leaving copy-on-write pages to fault on.
+static int
+supercowfault(pte_t *pte, uint64 *old)
+{
+  uint64 pa;
   uint flags;
   char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(ksuperrefcnt((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    return 0;
+  }
+  if((mem = ksuperalloc()) == 0)
+    return demote(pte);
+  memmove(mem, (char*)pa, SUPERPGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  if(old)
+    *old = pa | 1;
+  else
+    ksuperfree((void*)pa);
+  __sync_fetch_and_add(&superstats.copied, 1);
+  return 0;
+}
+
+// Handle a write to the copy-on-write page at *pte:
+// give the process its own writable copy, or, if no
+// one else shares the page any more, make it writable.
+// If old isn't 0, a copied page isn't freed: the reference
+// to it moves to *old (with bit 0 set for a superpage), for
+// the caller to cowput() once no hart's TLB maps it.
+int
+cowfault(pte_t *pte, uint64 *old)
+{
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(old)
+    *old = 0;
+  if(*pte & PTE_SUPER)
+    return supercowfault(pte, old);
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefcnt((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  if(pa == (uint64)zeropage)
+    memset(mem, 0, PGSIZE);
+  else
     memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
+  *pte = PA2PTE(mem) | flags;
+  if(old)
+    *old = pa;
+  else
+    kfree((void*)pa);
+  return 0;
+}
+
+// Let go of a page that cowfault() copied.
+void
+cowput(uint64 old)
+{
+  if(old & 1)
+    ksuperfree((void*)(old & ~1));
+  else if(old)
+    kfree((void*)old);
+}
+
+// Let go of the pages that copy-on-write faults in p's
+// current system call copied from while it held a spinlock,
+// once other harts have flushed them (see uvmfault()).
+// Called as each system call returns.
+void
+cowdrain(struct proc *p)
+{
+  if(p->ncowold == 0)
+    return;
+  tlbshootdown(p->mm);
+  while(p->ncowold > 0)
+    cowput(p->cowold[--p->ncowold]);
+}
+
+// Get the page at va of file-backed region v. A page with
+// file data in it comes from the image cache, and *shared
+// is set to say it must not be written in place; one past
+// the file data is a new zeroed page. A page of a MAP_SHARED
+// mmap is written in place: it is the one page that every
+// process mapping the file there shares, and holds all the
+// file has there, however much each of them mapped. *major is
+// set if the file had to be read.
+// Returns 0 if out of memory or the read fails.
+static char *
+vmaload(struct vma *v, uint64 va, int *shared, int *major)
+{
+  char *mem;
+  uint64 i = va - v->start;
+  uint n = 0, version;
+  int locked, r, mapshared = v->type == VMA_MMAP && (v->flags & MAP_SHARED);
+
+  if(i < v->filesz)
+    n = v->filesz - i < PGSIZE ? v->filesz - i : PGSIZE;
+  *shared = n > 0 && !mapshared;
+  if(n == 0)
+    return kalloc_zeroed();
+  if(mapshared)
+    n = PGSIZE;
+
+  do {
+    if((mem = imgget(v->ip, v->off + i, n, mapshared)) != 0)
+      return mem;
+
+    if((mem = kalloc()) == 0)
+      return 0;
+    *major = 1;
+    // a system call holding ip's lock, e.g. writing the
+    // file from its own text, may fault here.
+    locked = holdingsleep(&v->ip->lock);
+    if(!locked)
+      ilock(v->ip);
+    version = v->ip->version;
+    r = readi(v->ip, 0, (uint64)mem, v->off + i, n);
+    if(!locked)
+      iunlock(v->ip);
+    if(r < 0){
       kfree(mem);
-      goto err;
+      return 0;
     }
+    // past the end of the file reads as zeros.
+    memset(mem + r, 0, PGSIZE - r);
+    // a shared page the file changed under is read again.
+  } while((mem = imgput(v->ip, version, v->off + i, n, mem, mapshared)) == 0);
+  return mem;
+}
+
+// PTE permissions for the pages of region v.
+static int
+vmaperm(struct vma *v)
+{
+  int perm = PTE_U;
+
+  if(v->type == VMA_UNMAP)
+    return perm;
+  if(v->type != VMA_MMAP)
+    return PTE_W|PTE_X|PTE_R|PTE_U;
+  if(v->prot & (PROT_READ|PROT_WRITE))
+    perm |= PTE_R;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+  return perm;
+}
+
+// Does the page at va of region v, or of the heap if v is
+// 0, start out as zeros of p's own, rather than file data or
+// memory shared with other processes?
+static int
+vmazero(struct vma *v, uint64 va)
+{
+  if(v == 0)
+    return 1;
+  if(v->type == VMA_MMAP && (v->flags & MAP_SHARED))
+    return 0;
+  return v->ip == 0 || va - v->start >= v->filesz;
+}
+
+// Map the 2MB-aligned block of heap around va in p with a
+// zeroed superpage, if the whole block lies below mm->sz and
+// outside every region, and nothing in it is mapped yet.
+// Returns 0 on success, -1 if the caller should map a page.
+// Caller holds mm->lock.
+static int
+superfault(struct proc *p, uint64 va)
+{
+  struct mm *mm = p->mm;
+  uint64 base = SUPERPGROUNDDOWN(va);
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+
+  if(base + SUPERPGSIZE > mm->sz)
+    return -1;
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(v->type != VMA_NONE && v->start < base + SUPERPGSIZE && v->end > base)
+      return -1;
+  // a level-1 PTE means some page of the block is mapped.
+  if((pte = walklevel(p->pagetable, base, 0, 1)) != 0 && *pte != 0)
+    return -1;
+  if((mem = ksuperalloc()) == 0)
+    return -1;
+  memset(mem, 0, SUPERPGSIZE);
+  if(mappages(p->pagetable, base, SUPERPGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
+    ksuperfree(mem);
+    return -1;
   }
+  tlbflush(p->pagetable, base, SUPERPGSIZE);
+  __sync_fetch_and_add(&superstats.mapped, 1);
   return 0;
+}
 
- err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+// Find the first page at or above *va, and below the
+// trapframes, that pagetable maps for user access with a
+// page-sized leaf. Set *va to it and return its PTE, or
+// return 0 if there is none.
+pte_t *
+uvmnext(pagetable_t pagetable, uint64 *va)
+{
+  pte_t *pte;
+  uint64 a;
+
+  for(a = PGROUNDDOWN(*va); a < USERTOP; a += PGSIZE){
+    if((pte = walklevel(pagetable, a, 0, 1)) == 0){
+      // no page-table page for this 1GB.
+      a = (a | ((SUPERPGSIZE << 9) - 1)) + 1 - PGSIZE;
+      continue;
+    }
+    if((*pte & PTE_V) == 0 || (*pte & PTE_SUPER)){
+      a = (a | (SUPERPGSIZE - 1)) + 1 - PGSIZE;
+      continue;
+    }
+    pte = (pte_t*)PTE2PA(*pte) + PX(0, a);
+    if((*pte & (PTE_V|PTE_U)) == (PTE_V|PTE_U)){
+      *va = a;
+      return pte;
+    }
+  }
+  return 0;
+}
+
+// uvmfault() has run out of memory. If the caller may
+// sleep, swap some pages out and have it retry.
+static int
+uvmoom(void)
+{
+  if(cansleep() && reclaim() > 0)
+    return 0;
   return -1;
 }
 
+// Read the swapped-out page at va in p, whose PTE was old,
+// back in.
+static int
+swapfault(struct proc *p, uint64 va, pte_t old)
+{
+  struct mm *mm = p->mm;
+  pte_t *pte;
+  char *mem;
+
+  // reading the page sleeps.
+  if(!cansleep())
+    return -1;
+  if((mem = kalloc()) == 0)
+    return uvmoom();
+  swapin(PTE2SLOT(old), mem);
+  acquire(&mm->lock);
+  pte = walk(p->pagetable, va, 0);
+  if(*pte != old){
+    // changed while we slept; look again.
+    release(&mm->lock);
+    kfree(mem);
+    return 0;
+  }
+  // accessed, so that it isn't the next to go.
+  *pte = PA2PTE(mem) | (PTE_FLAGS(old) & ~PTE_SWAP) | PTE_A | PTE_V;
+  swapfree(PTE2SLOT(old));
+  tlbflush(p->pagetable, va, PGSIZE);
+  release(&mm->lock);
+  p->majflt++;
+  return 0;
+}
+
+// Choose up to max pages of p to swap out, and take them out
+// of p's page table: set pa[i] to each page and slot[i] to a
+// swap slot allocated for it, whose number the page's PTE now
+// holds. A page is chosen if its accessed bit is still clear
+// since the last time round; the bits of the pages passed
+// over are cleared. Only pages mapped by p alone are taken,
+// and not those of superpages, MAP_SHARED mmaps or the
+// current system call's buffers (see uvmtouch()).
+// Caller holds p->lock, p has its address space to itself,
+// and p isn't running unless it is the current process.
+// Returns the number of pages.
+int
+uvmevict(struct proc *p, uint64 *pa, int *slot, int max)
+{
+  struct mm *mm = p->mm;
+  pte_t *pte;
+  struct vma *v;
+  uint64 a, va;
+  int n = 0, scanned = 0, wrapped = 0, s;
+
+  acquire(&mm->lock);
+  a = mm->swapva;
+  while(n < max && scanned++ < EVICTSCAN){
+    if((pte = uvmnext(p->pagetable, &a)) == 0){
+      if(wrapped++)
+        break;
+      a = 0;
+      continue;
+    }
+    va = a;
+    a += PGSIZE;
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      continue;
+    }
+    if(krefcnt((void*)PTE2PA(*pte)) != 1 || (va >= p->pinva && va < p->pinend))
+      continue;
+    if((v = vmalookup(p, va)) != 0 &&
+       ((v->type == VMA_MMAP && (v->flags & MAP_SHARED)) || v->type == VMA_UNMAP))
+      continue;  // munmap() may be writing it back
+    if((s = swapalloc()) < 0)
+      break;
+    pa[n] = PTE2PA(*pte);
+    slot[n] = s;
+    n++;
+    *pte = SLOT2PTE(s) | (PTE_FLAGS(*pte) & ~(PTE_V|PTE_A|PTE_D)) | PTE_SWAP;
+    tlbflush(p->pagetable, va, PGSIZE);
+  }
+  mm->swapva = a;
+  if(p != myproc())
+    mm->tlbcpus = 0;  // flush before it next runs
+  release(&mm->lock);
+  return n;
+}
+
+// Handle a page fault at va in process p, on an access that
+// needs PTE_R, PTE_W or PTE_X.
+// A page that was never touched is filled in: from the
+// image cache, copy-on-write, if it is in a file-backed
+// region, or writable if that is a MAP_SHARED mmap, or else
+// allocated and zeroed, along with the
+// rest of its 2MB block if that is all untouched heap.
+// Anonymous memory that is only read gets the zero page.
+// A swapped-out page is read back in. A write to a
+// copy-on-write page copies it. If memory runs out, some
+// is swapped out to make room. Another thread may have
+// dealt with the same page first.
+// Returns 0 if the access can be retried, -1 if it is
+// illegal or there is no memory.
+int
+uvmfault(struct proc *p, uint64 va, int access)
+{
+  struct mm *mm = p->mm;
+  pte_t *pte, old;
+  struct vma *v;
+  char *mem;
+  int perm, shared, major = 0, write = access == PTE_W, held;
+  uint64 sz, oldpa = 0;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  v = vmalookup(p, va);
+  if(v == 0 && va >= mm->sz)
+    return -1;
+  if(v && (vmaperm(v) & (PTE_R|PTE_X)) == 0)
+    return -1;  // PROT_NONE
+  if(v && write && (vmaperm(v) & PTE_W) == 0)
+    return -1;
+
+  acquire(&mm->lock);
+  pte = walk(p->pagetable, va, 0);
+  if(pte && SWAPPED(*pte)){
+    old = *pte;
+    release(&mm->lock);
+    return swapfault(p, va, old);
+  }
+  if(pte && (*pte & PTE_V)){
+    if((*pte & PTE_U) == 0)
+      goto bad;  // guard page
+    if(*pte & access){
+      // filled in by another thread, after this hart
+      // looked at the old PTE.
+      tlbflush(p->pagetable, va, PGSIZE);
+      release(&mm->lock);
+      return 0;
+    }
+    if(!write || (*pte & PTE_COW) == 0)
+      goto bad;
+    // copying a superpage may split it.
+    sz = (*pte & PTE_SUPER) ? SUPERPGSIZE : PGSIZE;
+    // other threads' harts may still map the old page, which
+    // its other sharer could write in place or free once it
+    // is theirs alone; keep it until they have flushed. a
+    // copyout() under a spinlock can't wait for that, so the
+    // page waits for the system call to return instead; that
+    // is rare, as uvmtouch() copies ahead of such copies.
+    held = mycpu()->noff > 0;
+    if(held && mm->ref > 1 && p->ncowold == NCOWOLD)
+      goto bad;
+    if(cowfault(pte, mm->ref > 1 ? &oldpa : 0) < 0){
+      release(&mm->lock);
+      return uvmoom();
+    }
+    tlbflush(p->pagetable, va & ~(sz - 1), sz);
+    release(&mm->lock);
+    if(oldpa && held){
+      p->cowold[p->ncowold++] = oldpa;
+    } else if(oldpa){
+      tlbshootdown(mm);
+      cowput(oldpa);
+    }
+    p->minflt++;
+    return 0;
+  }
+
+  if(v == 0 && superfault(p, va) == 0){
+    release(&mm->lock);
+    p->minflt++;
+    return 0;
+  }
+  release(&mm->lock);
+
+  // threads get pages of their own even when reading: a
+  // thread whose hart's TLB still maps the zero page would
+  // miss another's first write until its next trap.
+  perm = v ? vmaperm(v) : PTE_W|PTE_X|PTE_R|PTE_U;
+  if(!write && mm->ref == 1 && vmazero(v, va)){
+    mem = zeropage;
+    kdup(mem);
+    if(perm & PTE_W)
+      perm = (perm & ~PTE_W) | PTE_COW;
+  } else if(v && v->ip){
+    mem = vmaload(v, va, &shared, &major);
+    if(shared && (perm & PTE_W))
+      perm = (perm & ~PTE_W) | PTE_COW;
+  } else {
+    mem = kalloc_zeroed();
+  }
+  if(mem == 0)
+    return uvmoom();
+
+  // reading the page may have slept.
+  acquire(&mm->lock);
+  if(vmalookup(p, va) != v || (v == 0 && va >= mm->sz)){
+    release(&mm->lock);
+    kfree(mem);
+    return -1;
+  }
+  if((pte = walk(p->pagetable, va, 0)) != 0 && *pte != 0){
+    release(&mm->lock);
+    kfree(mem);
+    return 0;
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    release(&mm->lock);
+    kfree(mem);
+    return uvmoom();
+  }
+  tlbflush(p->pagetable, va, PGSIZE);
+  release(&mm->lock);
+  if(major)
+    p->majflt++;
+  else
+    p->minflt++;
+  return 0;
+
+ bad:
+  release(&mm->lock);
+  return -1;
+}
+
+// Fault in the not-yet-loaded file-backed pages and the
+// swapped-out pages of [va, va+n) in p, and keep reclaim()
+// from swapping them out again until the system call returns.
+// Reading them sleeps, so system calls call this before taking
+// a spinlock, an inode lock, or a buffer under which they
+// copy to or from user memory; n is as much as they can copy.
+// If write is set, they will copy to it, and copy-on-write
+// pages are copied now too, since that may wait for other
+// harts (see tlbshootdown()). A copy stops at the first page
+// that isn't user memory, and so does this.
+// Errors are left for the copy itself to report.
+void
+uvmtouch(struct proc *p, uint64 va, uint64 n, int write)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint64 a, end;
+  int access = write ? PTE_W : PTE_R;
+
+  end = va + n;
+  if(end < va || end > USERTOP)
+    end = USERTOP;
+  for(a = PGROUNDDOWN(va); a < end; a = v ? v->end : PGROUNDUP(p->mm->sz)){
+    v = vmalookup(p, a);
+    if(v ? (vmaperm(v) & (PTE_R|PTE_X)) == 0 : a >= p->mm->sz)
+      break;
+  }
+  if(a < end)
+    end = a;
+  p->pinva = PGROUNDDOWN(va);
+  p->pinend = end;
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++){
+    if(v->type == VMA_NONE || v->ip == 0 || end <= v->start || va >= v->end)
+      continue;
+    a = va > v->start ? PGROUNDDOWN(va) : v->start;
+    for(; a < end && a < v->end; a += PGSIZE)
+      if(walkaddr(p->pagetable, a) == 0)
+        uvmfault(p, a, access);
+  }
+  for(a = PGROUNDDOWN(va); a < end && a < USERTOP; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) == 0)
+      a = (a | (SUPERPGSIZE - 1)) + 1 - PGSIZE;
+    else if(SWAPPED(*pte) || (write && (*pte & PTE_COW)))
+      uvmfault(p, a, access);
+  }
+}
+
+// Return the physical address of the user int at va in p,
+// for futex(). The page is faulted in writable first, so that
+// it is p's own rather than copy-on-write, and the caller gets
+// a reference to it, which keeps reclaim() and ksmscan() off
+// it until the caller kfree()s PGROUNDDOWN() of the address.
+// Returns 0 if va isn't writable user memory.
+uint64
+uvmword(struct proc *p, uint64 va)
+{
+  struct mm *mm = p->mm;
+  pte_t *pte;
+  uint64 pa;
+
+  if(va % sizeof(int) != 0 || va >= USERTOP)
+    return 0;
+  // another thread, or reclaim(), may change the PTE between
+  // the fault and looking at it.
+  while(uvmfault(p, va, PTE_W) == 0){
+    acquire(&mm->lock);
+    pte = walk(p->pagetable, va, 0);
+    if(pte && (*pte & PTE_SUPER)){
+      if(demote(pte) < 0){
+        release(&mm->lock);
+        return 0;
+      }
+      pte = walk(p->pagetable, va, 0);
+    }
+    if(pte && (*pte & (PTE_V|PTE_U|PTE_W)) == (PTE_V|PTE_U|PTE_W)){
+      pa = PTE2PA(*pte);
+      kdup((void*)pa);
+      release(&mm->lock);
+      return pa + (va % PGSIZE);
+    }
+    release(&mm->lock);
+  }
+  return 0;
+}
+
+// The current process if pagetable is its page table,
+// so that the copy functions below fault in pages only
+// for the process they run on behalf of.
+static struct proc *
+userproc(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || p->pagetable != pagetable)
+    return 0;
+  return p;
+}
+
+// Count the pages of user memory that pagetable maps, the
+// pages out in swap, and the page-table pages, into ru.
+void
+uvmusage(pagetable_t pagetable, struct rusage *ru)
+{
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if(SWAPPED(pte)){
+      ru->swapped++;
+    } else if((pte & PTE_V) == 0){
+      continue;
+    } else if((pte & (PTE_R|PTE_W|PTE_X)) == 0){
+      uvmusage((pagetable_t)PTE2PA(pte), ru);
+    } else if(pte & PTE_U){
+      ru->rss += (pte & PTE_SUPER) ? SUPERPGSIZE/PGSIZE : 1;
+    }
+  }
+  ru->ptpages++;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -340,27 +1310,61 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Find the run of user memory at va in pagetable, up to n
+// bytes, that is mapped with at least perm in physically
+// contiguous pages, and set *pa to the physical address of
+// va, so that the copy functions below can move it with one
+// memmove(). The PTEs of consecutive pages sit side by side
+// in a page-table page, so the run takes one walk().
+// Returns the length of the run, or 0 if the page at va
+// isn't mapped so.
+static uint
+uvmrun(pagetable_t pagetable, uint64 va, uint64 n, int perm, uint64 *pa)
+{
+  pte_t *pte;
+  uint64 a, run;
+
+  perm |= PTE_V | PTE_U;
+  if(va >= MAXVA || (pte = walk(pagetable, va, 0)) == 0 || (*pte & perm) != perm)
+    return 0;
+  *pa = pteaddr(pte, va) + (va % PGSIZE);
+  if(*pte & PTE_SUPER){
+    run = SUPERPGSIZE - (va % SUPERPGSIZE);
+  } else {
+    run = PGSIZE - (va % PGSIZE);
+    for(a = PGROUNDDOWN(va); run < n && PX(0, a) != PXMASK; a += PGSIZE){
+      pte++;
+      if((*pte & perm) != perm || PTE2PA(*pte) != *pa + run)
+        break;
+      run += PGSIZE;
+    }
+  }
+  return run < n ? run : n;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
-  uint64 n, va0, pa0;
+  uint64 pa;
+  uint n;
+  struct proc *p;
 
   while(len > 0){
-    va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
-    n = PGSIZE - (dstva - va0);
-    if(n > len)
-      n = len;
-    memmove((void *)(pa0 + (dstva - va0)), src, n);
+    if((n = uvmrun(pagetable, dstva, len, PTE_W, &pa)) == 0){
+      // not yet touched, or copy-on-write. a copy-on-write
+      // superpage may only be split by the first fault.
+      if((p = userproc(pagetable)) == 0 || uvmfault(p, dstva, PTE_W) < 0)
+        return -1;
+      continue;
+    }
+    memmove((void *)pa, src, n);
 
     len -= n;
     src += n;
-    dstva = va0 + PGSIZE;
+    dstva += n;
   }
   return 0;
 }
@@ -371,21 +1375,21 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
-  uint64 n, va0, pa0;
+  uint64 pa;
+  uint n;
+  struct proc *p;
 
   while(len > 0){
-    va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
-    n = PGSIZE - (srcva - va0);
-    if(n > len)
-      n = len;
-    memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+    if((n = uvmrun(pagetable, srcva, len, PTE_R, &pa)) == 0){
+      if((p = userproc(pagetable)) == 0 || uvmfault(p, srcva, PTE_R) < 0)
+        return -1;
+      continue;
+    }
+    memmove(dst, (void *)pa, n);
 
     len -= n;
     dst += n;
-    srcva = va0 + PGSIZE;
+    srcva += n;
   }
   return 0;
 }
@@ -397,38 +1401,40 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 int
 copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-  uint64 n, va0, pa0;
-  int got_null = 0;
+  uint64 pa;
+  uint n, len;
+  struct proc *p;
 
-  while(got_null == 0 && max > 0){
-    va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
-    n = PGSIZE - (srcva - va0);
-    if(n > max)
-      n = max;
-
-    char *p = (char *) (pa0 + (srcva - va0));
-    while(n > 0){
-      if(*p == '\0'){
-        *dst = '\0';
-        got_null = 1;
-        break;
-      } else {
-        *dst = *p;
-      }
-      --n;
-      --max;
-      p++;
-      dst++;
+  while(max > 0){
+    if((n = uvmrun(pagetable, srcva, max, PTE_R, &pa)) == 0){
+      if((p = userproc(pagetable)) == 0 || uvmfault(p, srcva, PTE_R) < 0)
+        return -1;
+      continue;
+    }
+    len = strnlen((char *)pa, n);
+    if(len < n){
+      memmove(dst, (void *)pa, len + 1);
+      return 0;
     }
+    memmove(dst, (void *)pa, n);
 
-    srcva = va0 + PGSIZE;
-  }
-  if(got_null){
-    return 0;
-  } else {
-    return -1;
+    max -= n;
+    dst += n;
+    srcva += n;
   }
+  return -1;
+}
+
+int
+statsvm(char *buf, int sz)
+{
+  int n;
+
+  n = snprintf(buf, sz, "--- superpages: mapped %d copied %d split %d\n",
+               superstats.mapped, superstats.copied, superstats.split);
+  n += snprintf(buf+n, sz-n, "--- zero page: mappings %d\n", krefcnt(zeropage) - 1);
+  n += snprintf(buf+n, sz-n, "--- tlb flushes: all %d asid %d page %d shootdown %d; asids %d rollovers %d\n",
+                tlbstats.all, tlbstats.asid, tlbstats.page, tlbstats.shootdown,
+                asids.n, tlbstats.rollover);
+  return n;
 }
@@ -0,0 +1,84 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// measure how fast the kernel zeroes and copies memory.
+// sbrk() is lazy, so touch each new page: the fault zeroes
+// it with memset(). read() of a cached file copies each
+// block out with memmove().
+// reports bytes per cycle of the time CSR, times 100.
+
+#define SBRKSZ   (256*PGSIZE)
+#define SBRKN    32
+#define FILESZ   (8*1024)
+#define READN    512
+
+char buf[FILESZ];
+
+void
+report(char *what, uint64 bytes, uint64 cycles)
+{
+  uint64 bpc100 = cycles ? bytes * 100 / cycles : 0;
+
+  printf("%s: %d bytes, %d cycles, %d.%d%d bytes/cycle\n", what,
+         (int)bytes, (int)cycles, (int)(bpc100 / 100),
+         (int)(bpc100 / 10 % 10), (int)(bpc100 % 10));
+}
+
+void
+bench_memset(void)
+{
+  uint64 t0, t1;
+  char *p;
+  int i, j;
+
+  t0 = r_time();
+  for(i = 0; i < SBRKN; i++){
+    if((p = sbrk(SBRKSZ)) == (char*)-1){
+      printf("membench: sbrk failed\n");
+      exit(1);
+    }
+    for(j = 0; j < SBRKSZ; j += PGSIZE)
+      p[j] = 1;
+    sbrk(-SBRKSZ);
+  }
+  t1 = r_time();
+  report("memset (sbrk+touch)", (uint64)SBRKN * SBRKSZ, t1 - t0);
+}
+
+void
+bench_memmove(void)
+{
+  uint64 t0, t1;
+  int fd, i;
+
+  fd = open("membench.tmp", O_CREATE|O_WRONLY);
+  if(fd < 0 || write(fd, buf, FILESZ) != FILESZ){
+    printf("membench: cannot create membench.tmp\n");
+    exit(1);
+  }
+  close(fd);
+
+  t0 = r_time();
+  for(i = 0; i < READN; i++){
+    fd = open("membench.tmp", O_RDONLY);
+    if(fd < 0 || read(fd, buf, FILESZ) != FILESZ){
+      printf("membench: read failed\n");
+      exit(1);
+    }
+    close(fd);
+  }
+  t1 = r_time();
+  unlink("membench.tmp");
+  report("memmove (read)", (uint64)READN * FILESZ, t1 - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  bench_memset();
+  bench_memmove();
+  exit(0);
+}
@@ -0,0 +1,25 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+// nice n cmd [arg...]: run cmd at scheduler priority
+// level n and below, from 0 (the default, highest) to
+// NPRIO-1.
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  if(argc < 3){
+    fprintf(2, "usage: nice n cmd [arg...]\n");
+    exit(1);
+  }
+  n = atoi(argv[1]);
+  if(setpriority(0, n) < 0){
+    fprintf(2, "nice: bad level %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,72 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+// list processes with the memory they hold and the page
+// faults they have taken. memory is in pages; a page that
+// processes share counts for each of them.
+//   rss    resident pages
+//   swap   pages out in swap
+//   pt     page-table pages
+//   minflt page faults served from memory
+//   majflt page faults that read a file or swap
+//   pri    scheduler priority level, 0 the highest
+//   ni     highest level it may run at (see nice)
+//   cpu    cpu it last ran on
+//   mig    times it has moved to another cpu
+
+// print s left-aligned in a field of w columns.
+void
+field(char *s, int w)
+{
+  int n = strlen(s);
+
+  printf("%s", s);
+  for(; n < w; n++)
+    printf(" ");
+}
+
+void
+num(uint64 x, int w)
+{
+  char buf[24];
+  int i = sizeof(buf) - 1;
+
+  buf[i] = 0;
+  do {
+    buf[--i] = '0' + x % 10;
+    x /= 10;
+  } while(x);
+  field(buf + i, w);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct rusage ru;
+  int pid;
+
+  printf("pid   ppid  state   pri ni cpu mig   name            sz       rss    swap   pt   minflt  majflt\n");
+  for(pid = 1; (pid = getrusage(pid, &ru)) > 0; pid++){
+    num(ru.pid, 6);
+    num(ru.ppid, 6);
+    field(ru.state, 8);
+    num(ru.prio, 4);
+    num(ru.nice, 3);
+    if(ru.cpu >= 0)
+      num(ru.cpu, 4);
+    else
+      field("-", 4);
+    num(ru.nmigrate, 6);
+    field(ru.name, 16);
+    num(ru.sz, 9);
+    num(ru.rss, 7);
+    num(ru.swapped, 7);
+    num(ru.ptpages, 5);
+    num(ru.minflt, 8);
+    num(ru.majflt, 0);
+    printf("\n");
+  }
+  exit(0);
+}
@@ -52,12 +52,15 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+int spawnable(struct cmd*);
+int spawncmd(struct cmd*, int*);
+int plainline(char*);
 
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
 {
-  int p[2];
+  int p[2], fds[3], n;
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
@@ -101,24 +104,44 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
-      close(1);
-      dup(p[1]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->left);
+    // a side that is just a command is spawn()ed, with only
+    // its own end of the pipe.
+    n = 0;
+    fds[0] = 0;
+    fds[1] = p[1];
+    fds[2] = 2;
+    if(spawnable(pcmd->left)){
+      if(spawncmd(pcmd->left, fds) > 0)
+        n++;
+    } else {
+      if(fork1() == 0){
+        close(1);
+        dup(p[1]);
+        close(p[0]);
+        close(p[1]);
+        runcmd(pcmd->left);
+      }
+      n++;
     }
-    if(fork1() == 0){
-      close(0);
-      dup(p[0]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->right);
+    fds[0] = p[0];
+    fds[1] = 1;
+    if(spawnable(pcmd->right)){
+      if(spawncmd(pcmd->right, fds) > 0)
+        n++;
+    } else {
+      if(fork1() == 0){
+        close(0);
+        dup(p[0]);
+        close(p[0]);
+        close(p[1]);
+        runcmd(pcmd->right);
+      }
+      n++;
     }
     close(p[0]);
     close(p[1]);
-    wait(0);
-    wait(0);
+    while(n-- > 0)
+      wait(0);
     break;
 
   case BACK:
@@ -130,6 +153,45 @@ runcmd(struct cmd *cmd)
   exit(0);
 }
 
+// Is cmd a command with at most redirections, which
+// spawncmd() can start without a copy of the shell?
+int
+spawnable(struct cmd *cmd)
+{
+  while(cmd->type == REDIR)
+    cmd = ((struct redircmd*)cmd)->cmd;
+  return cmd->type == EXEC && ((struct execcmd*)cmd)->argv[0] != 0;
+}
+
+// Start cmd, which must be spawnable(), in a child made by
+// spawn(), with fds as its 0, 1 and 2, or with all the
+// shell's fds if fds is 0. Returns the child's pid, or -1.
+int
+spawncmd(struct cmd *cmd, int *fds)
+{
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  int fd, pid, nfds[3] = { 0, 1, 2 };
+
+  if(cmd->type == REDIR){
+    rcmd = (struct redircmd*)cmd;
+    if((fd = open(rcmd->file, rcmd->mode)) < 0){
+      fprintf(2, "open %s failed\n", rcmd->file);
+      return -1;
+    }
+    if(fds)
+      memmove(nfds, fds, sizeof(nfds));
+    nfds[rcmd->fd] = fd;
+    pid = spawncmd(rcmd->cmd, nfds);
+    close(fd);
+    return pid;
+  }
+  ecmd = (struct execcmd*)cmd;
+  if((pid = spawn(ecmd->argv[0], ecmd->argv, fds)) < 0)
+    fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+  return pid;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -145,6 +207,7 @@ int
 main(void)
 {
   static char buf[100];
+  struct cmd *cmd;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -164,6 +227,13 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
+    if(plainline(buf)){
+      cmd = parsecmd(buf);
+      if(spawncmd(cmd, 0) > 0)
+        wait(0);
+      free(cmd);
+      continue;
+    }
     if(fork1() == 0)
       runcmd(parsecmd(buf));
     wait(0);
@@ -262,6 +332,32 @@ backcmd(struct cmd *subcmd)
 char whitespace[] = " \t\r\n\v";
 char symbols[] = "<|>&;()";
 
+// Is buf a line of words only, and not too many, which
+// parsecmd() can't fail to parse? The shell parses such a
+// line itself, and spawn()s the command, rather than leave
+// it to a copy of itself that may exit on a syntax error.
+int
+plainline(char *buf)
+{
+  char *s = buf;
+  int n = 0;
+
+  for(;;){
+    while(*s && strchr(whitespace, *s))
+      s++;
+    if(*s == 0)
+      break;
+    if(++n >= MAXARGS)
+      return 0;
+    while(*s && !strchr(whitespace, *s)){
+      if(strchr(symbols, *s))
+        return 0;
+      s++;
+    }
+  }
+  return n > 0;
+}
+
 int
 gettoken(char **ps, char *es, char **q, char **eq)
 {
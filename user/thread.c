@@ -0,0 +1,93 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Threads on top of clone(): each runs on a stack of its
+// own from malloc(), in the address space of the process
+// that made it. Only the thread that made a thread may join
+// it, since joining is wait(), and a process with threads
+// shouldn't have forked children of its own to wait for as
+// well. malloc() isn't safe to call from more than one
+// thread at once, so neither is thread_create().
+
+#define STACKSIZE (4*4096)
+
+struct thread {
+  int tid;
+  int done;
+  void (*fn)(void*);
+  void *arg;
+  char *stack;
+  struct thread *next;
+};
+
+static struct thread *threads;
+
+static void
+start(void *arg)
+{
+  struct thread *t = arg;
+
+  t->fn(t->arg);
+  exit(0);
+}
+
+// Start a thread running fn(arg). Returns its thread id,
+// or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  struct thread *t;
+
+  if((t = malloc(sizeof(*t))) == 0)
+    return -1;
+  if((t->stack = malloc(STACKSIZE)) == 0){
+    free(t);
+    return -1;
+  }
+  t->fn = fn;
+  t->arg = arg;
+  t->done = 0;
+  if((t->tid = clone(start, t, t->stack + STACKSIZE)) < 0){
+    free(t->stack);
+    free(t);
+    return -1;
+  }
+  t->next = threads;
+  threads = t;
+  return t->tid;
+}
+
+// Wait for thread tid to finish. Returns 0, or -1 if
+// there is no such thread.
+int
+thread_join(int tid)
+{
+  struct thread *t, **pp;
+  int pid;
+
+  for(pp = &threads; (t = *pp) != 0; pp = &t->next)
+    if(t->tid == tid)
+      break;
+  if(t == 0)
+    return -1;
+  while(!t->done){
+    if((pid = wait(0)) < 0)
+      return -1;
+    // another thread may finish first.
+    for(struct thread *u = threads; u; u = u->next)
+      if(u->tid == pid)
+        u->done = 1;
+  }
+  *pp = t->next;
+  free(t->stack);
+  free(t);
+  return 0;
+}
+
+// End the calling thread.
+void
+thread_exit(void)
+{
+  exit(0);
+}
@@ -0,0 +1,68 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// measure what superpages save in TLB misses.
+// walks a large array a page at a time, so that nearly every
+// access needs a different translation: once in 2MB-aligned
+// heap, which the kernel maps with superpages, and once in an
+// anonymous mmap, which it maps with 4KB pages.
+// see the superpage counters in the statistics device.
+
+#define ARRAYSZ  (16*1024*1024)
+#define ROUNDS   16
+
+uint64
+walk(char *a)
+{
+  uint64 t0, t1;
+  int i, r;
+
+  // fault everything in first.
+  for(i = 0; i < ARRAYSZ; i += PGSIZE)
+    a[i] = 1;
+
+  t0 = r_time();
+  for(r = 0; r < ROUNDS; r++)
+    for(i = (r * 64) % PGSIZE; i < ARRAYSZ; i += PGSIZE)
+      a[i]++;
+  t1 = r_time();
+  return t1 - t0;
+}
+
+void
+report(char *what, uint64 cycles)
+{
+  int n = ROUNDS * (ARRAYSZ / PGSIZE);
+
+  printf("%s: %d accesses, %d cycles, %d cycles/access\n", what,
+         n, (int)cycles, (int)(cycles / n));
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *a;
+  uint64 brk;
+
+  // 2MB-align the break, then grow the heap.
+  brk = (uint64)sbrk(0);
+  if(sbrk(SUPERPGROUNDUP(brk) - brk) == (char*)-1 ||
+     (a = sbrk(ARRAYSZ)) == (char*)-1){
+    printf("tlbbench: sbrk failed\n");
+    exit(1);
+  }
+  report("heap (2MB superpages)", walk(a));
+  sbrk(-ARRAYSZ);
+
+  a = mmap(0, ARRAYSZ, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED){
+    printf("tlbbench: mmap failed\n");
+    exit(1);
+  }
+  report("mmap (4KB pages)", walk(a));
+  munmap(a, ARRAYSZ);
+  exit(0);
+}
@@ -134,3 +134,78 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Mutexes and condition variables for threads, and for
+// processes that share memory, on top of futex(). A mutex's
+// v is 0 when it is free, 1 when held, and 2 when held with
+// others perhaps waiting, so that taking and releasing one
+// nobody else wants needn't enter the kernel.
+
+void
+mutex_init(struct mutex *m)
+{
+  m->v = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->v, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __atomic_exchange_n(&m->v, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex(&m->v, FUTEX_WAIT, 2);
+    c = __atomic_exchange_n(&m->v, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__atomic_exchange_n(&m->v, 0, __ATOMIC_RELEASE) == 2)
+    futex(&m->v, FUTEX_WAKE, 1);
+}
+
+// A condition variable's seq changes with every signal, so
+// that one which comes between cond_wait() letting go of the
+// mutex and calling futex() isn't missed.
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+  c->waiters = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+
+  __sync_fetch_and_add(&c->waiters, 1);
+  mutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  __sync_fetch_and_sub(&c->waiters, 1);
+  // others woken with us may be waiting for m too.
+  while(__atomic_exchange_n(&m->v, 2, __ATOMIC_ACQUIRE) != 0)
+    futex(&m->v, FUTEX_WAIT, 2);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  if(__atomic_load_n(&c->waiters, __ATOMIC_RELAXED))
+    futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  if(__atomic_load_n(&c->waiters, __ATOMIC_RELAXED))
+    futex(&c->seq, FUTEX_WAKE, 0x7fffffff);
+}
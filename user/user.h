@@ -1,5 +1,16 @@
 struct stat;
 struct rtcdate;
+struct rusage;
+
+// see mutex_lock() and cond_wait() in ulib.c.
+struct mutex {
+  int v;
+};
+
+struct cond {
+  int seq;
+  int waiters;
+};
 
 /**
  * xv6上的用户程序有一组有限的可用库函数，您可以在<user/user.h>中看到所有可调用的函数
@@ -30,6 +41,14 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int getrusage(int, struct rusage*);
+int setpriority(int, int);
+int setaffinity(int, int);
+int clone(void (*)(void*), void*, void*);
+int futex(int*, int, int);
+int spawn(char*, char**, int*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -47,3 +66,18 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+
+// statistics.c
+int statistics(void*, int);
+
+// thread.c
+int thread_create(void (*)(void*), void*);
+int thread_join(int);
+void thread_exit(void) __attribute__((noreturn));
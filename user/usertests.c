@@ -5,6 +5,7 @@
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
 #include "kernel/syscall.h"
+#include "kernel/rusage.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
 
@@ -2080,6 +2081,762 @@ forktest(char *s)
   }
 }
 
+// fork a process that uses two thirds of physical memory,
+// which only fits if fork shares pages copy-on-write, and
+// check that parent and child each see their own writes.
+void
+cowfork(char *s)
+{
+  int sz = ((PHYSTOP - KERNBASE) / 3) * 2;
+  char *a, *p;
+  int pid, xstatus;
+
+  a = sbrk(sz);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(%d) failed\n", s, sz);
+    exit(1);
+  }
+  for(p = a; p < a + sz; p += PGSIZE)
+    *(int*)p = 1;
+
+  for(int i = 0; i < 3; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(p = a; p < a + 16*PGSIZE; p += PGSIZE)
+        *(int*)p = 2;
+      for(p = a; p < a + 16*PGSIZE; p += PGSIZE)
+        if(*(int*)p != 2)
+          exit(1);
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: child saw wrong data\n", s);
+      exit(1);
+    }
+  }
+
+  for(p = a; p < a + sz; p += PGSIZE){
+    if(*(int*)p != 1){
+      printf("%s: parent saw child's write\n", s);
+      exit(1);
+    }
+  }
+
+  if(sbrk(-sz) == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(-%d) failed\n", s, sz);
+    exit(1);
+  }
+}
+
+// grow by much more than physical memory, touch a few
+// scattered pages, and check that fork, system calls and
+// shrinking all cope with the untouched holes in between.
+void
+sbrksparse(char *s)
+{
+  enum { BIG=512*1024*1024 };
+  char *a, *p;
+  int fd, pid, xstatus;
+
+  a = sbrk(BIG);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(%d) failed\n", s, BIG);
+    exit(1);
+  }
+  for(p = a; p < a + BIG; p += BIG/8)
+    *p = 'x';
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(p = a; p < a + BIG; p += BIG/8)
+      if(*p != 'x')
+        exit(1);
+    if(a[BIG/16] != 0)
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+
+  // the kernel faults in pages that read() and write() touch.
+  fd = open("sbrksparse", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if(write(fd, a + BIG/16, PGSIZE) != PGSIZE){
+    printf("%s: write from untouched page failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("sbrksparse", O_RDONLY);
+  if(read(fd, a + 3*(BIG/16), PGSIZE) != PGSIZE){
+    printf("%s: read into untouched page failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("sbrksparse");
+
+  if(sbrk(-BIG) == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(-%d) failed\n", s, BIG);
+    exit(1);
+  }
+}
+
+// map a file private and shared, and anonymous memory;
+// check what the file and a forked child see, and that
+// a partial munmap leaves the rest mapped.
+void
+mmaptest(char *s)
+{
+  enum { N=2*PGSIZE+100 };
+  char *p, *q, b[2];
+  int fd, i, pid, xstatus;
+
+  fd = open("mmaptest", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    if(write(fd, "abcdefghij" + i % 10, 1) != 1){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+
+  // private: writes stay in this process.
+  p = mmap(0, N, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    if(p[i] != 'a' + i % 10){
+      printf("%s: wrong byte %d in private mapping\n", s, i);
+      exit(1);
+    }
+  if(p[N] != 0){
+    printf("%s: past end of file not zero\n", s);
+    exit(1);
+  }
+  p[0] = 'Z';
+  if(munmap(p, N) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  // shared: a child's writes reach the parent and the file.
+  p = mmap(0, N, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+  if(p[0] != 'a'){
+    printf("%s: private write reached the file\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    p[1] = 'Y';
+    p[PGSIZE] = 'X';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || p[1] != 'Y' || p[PGSIZE] != 'X'){
+    printf("%s: parent didn't see child's write\n", s);
+    exit(1);
+  }
+  // unmap the middle page, then the rest.
+  if(munmap(p + PGSIZE, PGSIZE) < 0 || p[0] != 'a' || p[2*PGSIZE] != 'a' + (2*PGSIZE) % 10){
+    printf("%s: partial munmap failed\n", s);
+    exit(1);
+  }
+  if(munmap(p, PGSIZE) < 0 || munmap(p + 2*PGSIZE, N - 2*PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("mmaptest", O_RDONLY);
+  if(read(fd, b, 2) != 2 || b[0] != 'a' || b[1] != 'Y'){
+    printf("%s: shared write not in file\n", s);
+    exit(1);
+  }
+  // a read-only file can't be mapped shared and writable.
+  if(mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != MAP_FAILED){
+    printf("%s: mmap of read-only fd succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmaptest");
+
+  // anonymous: zeroed, copy-on-write across fork when private.
+  q = mmap(0, 4*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(q == MAP_FAILED){
+    printf("%s: mmap anonymous failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4*PGSIZE; i += PGSIZE){
+    if(q[i] != 0){
+      printf("%s: anonymous page not zero\n", s);
+      exit(1);
+    }
+    q[i] = 1;
+  }
+  pid = fork();
+  if(pid == 0){
+    q[0] = 2;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(q[0] != 1){
+    printf("%s: child's private write seen\n", s);
+    exit(1);
+  }
+  if(munmap(q, 4*PGSIZE) < 0){
+    printf("%s: munmap anonymous failed\n", s);
+    exit(1);
+  }
+}
+
+// two processes that map the same file shared on their own
+// see each other's writes, and both reach the file.
+void
+mmapshared(char *s)
+{
+  char *p, b[2];
+  int fd, up[2], down[2], pid, xstatus;
+
+  fd = open("mmapshared", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "ab", 2) != 2){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(pipe(up) < 0 || pipe(down) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  fd = open("mmapshared", O_RDWR);
+  p = mmap(0, 2, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(fd < 0 || p == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(pid == 0){
+    p[0] = 'C';
+    if(write(up[1], "x", 1) != 1 || read(down[0], b, 1) != 1){
+      printf("%s: child pipe failed\n", s);
+      exit(1);
+    }
+    if(p[1] != 'P'){
+      printf("%s: child didn't see parent's write\n", s);
+      exit(1);
+    }
+    munmap(p, 2);
+    exit(0);
+  }
+  if(read(up[0], b, 1) != 1 || p[0] != 'C'){
+    printf("%s: parent didn't see child's write\n", s);
+    exit(1);
+  }
+  p[1] = 'P';
+  if(write(down[1], "x", 1) != 1){
+    printf("%s: parent pipe failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  munmap(p, 2);
+  close(up[0]);
+  close(up[1]);
+  close(down[0]);
+  close(down[1]);
+
+  fd = open("mmapshared", O_RDONLY);
+  if(read(fd, b, 2) != 2 || b[0] != 'C' || b[1] != 'P'){
+    printf("%s: writes not in file\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapshared");
+}
+
+// untouched memory that is read shares the kernel's zero
+// page until it is written, which must not show through to
+// other pages or processes.
+void
+zeropage(char *s)
+{
+  enum { N=16 };
+  char *a;
+  int i, pid, xstatus;
+
+  a = sbrk(N*PGSIZE);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(a[i*PGSIZE] != 0 || a[i*PGSIZE + PGSIZE-1] != 0){
+      printf("%s: untouched page %d isn't zero\n", s, i);
+      exit(1);
+    }
+  }
+  a[3*PGSIZE] = 'x';
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a[5*PGSIZE + 1] = 'y';
+    exit(a[3*PGSIZE] != 'x' || a[4*PGSIZE] != 0 || a[5*PGSIZE + 1] != 'y');
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(i != 3 && (a[i*PGSIZE] != 0 || a[i*PGSIZE + 1] != 0)){
+      printf("%s: page %d isn't zero after writes\n", s, i);
+      exit(1);
+    }
+  }
+  sbrk(-N*PGSIZE);
+}
+
+// getrusage() counts the pages a process faults in.
+void
+rusagetest(char *s)
+{
+  enum { N=8 };
+  struct rusage r0, r1;
+  char *a;
+  int i;
+
+  if(getrusage(0, &r0) != getpid()){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  a = sbrk(N*PGSIZE);
+  for(i = 0; i < N; i++)
+    a[i*PGSIZE] = 1;
+  if(getrusage(0, &r1) != getpid()){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  if(r1.minflt < r0.minflt + N || r1.rss < r0.rss + N || r1.ptpages < 3){
+    printf("%s: faults %d -> %d, rss %d -> %d\n", s,
+           (int)r0.minflt, (int)r1.minflt, (int)r0.rss, (int)r1.rss);
+    exit(1);
+  }
+  if(strcmp(r1.name, "usertests") != 0 || r1.ppid == 0){
+    printf("%s: wrong name or parent\n", s);
+    exit(1);
+  }
+  // a pid that isn't in use describes the next one up.
+  if(getrusage(1, &r0) != 1 || getrusage(getpid()+1000, &r0) != -1){
+    printf("%s: getrusage by pid failed\n", s);
+    exit(1);
+  }
+  sbrk(-N*PGSIZE);
+}
+
+// setpriority() limits the levels a process runs at, and a
+// process that sleeps still gets the CPU promptly while
+// CPU-bound ones run.
+void
+priority(char *s)
+{
+  enum { N=6, ROUNDS=10 };
+  struct rusage ru;
+  int pids[N], i, t0, worst = 0;
+
+  if(setpriority(0, 2) != 0 || getrusage(0, &ru) < 0 || ru.nice != 2 || ru.prio < 2){
+    printf("%s: setpriority(0, 2) failed\n", s);
+    exit(1);
+  }
+  if(setpriority(0, NPRIO) != -1 || setpriority(getpid()+1000, 0) != -1){
+    printf("%s: bad setpriority succeeded\n", s);
+    exit(1);
+  }
+  if(setpriority(0, 0) != 2){
+    printf("%s: setpriority(0, 0) failed\n", s);
+    exit(1);
+  }
+
+  for(i = 0; i < N; i++){
+    if((pids[i] = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[i] == 0)
+      for(;;)
+        ;
+  }
+  sleep(BOOST/5);  // let them drop to the bottom level
+  for(i = 0; i < ROUNDS; i++){
+    t0 = uptime();
+    sleep(1);
+    if(uptime() - t0 > worst)
+      worst = uptime() - t0;
+  }
+  for(i = 0; i < N; i++){
+    kill(pids[i]);
+    wait(0);
+  }
+  if(worst > 5){
+    printf("%s: sleep(1) took %d ticks\n", s, worst);
+    exit(1);
+  }
+}
+
+// a process runs only on the cpus setaffinity() allows.
+void
+affinity(char *s)
+{
+  struct rusage ru;
+  int cpu, t0;
+
+  if(setaffinity(0, 0) != -1 || setaffinity(getpid()+1000, 1) != -1){
+    printf("%s: bad setaffinity succeeded\n", s);
+    exit(1);
+  }
+  for(cpu = 0; cpu < 2; cpu++){
+    if(setaffinity(0, 1 << cpu) < 0)
+      continue;  // only one cpu
+    t0 = uptime();
+    while(uptime() - t0 < 3)
+      ;
+    if(getrusage(0, &ru) < 0 || ru.cpu != cpu || ru.affinity != 1 << cpu){
+      printf("%s: running on cpu %d, not %d\n", s, ru.cpu, cpu);
+      exit(1);
+    }
+  }
+  setaffinity(0, -1);
+}
+
+// threads share memory and open files, and any still running
+// when the process that made them exits go with it.
+static volatile int threadsum[4];
+static int threadfd;
+
+static void
+threadadd(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  for(int k = 0; k < 100000; k++)
+    threadsum[i]++;
+  write(threadfd, "x", 1);
+}
+
+static void
+threadspin(void *arg)
+{
+  for(;;)
+    ;
+}
+
+void
+threads(char *s)
+{
+  enum { N=4 };
+  struct rusage ru;
+  int fds[2], tids[N], i, pid, tid, n, xstatus;
+  char buf[N];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  threadfd = fds[1];
+  for(i = 0; i < N; i++){
+    threadsum[i] = 0;
+    if((tids[i] = thread_create(threadadd, (void*)(uint64)i)) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i++){
+    if(thread_join(tids[i]) < 0 || threadsum[i] != 100000){
+      printf("%s: thread %d: sum %d\n", s, i, threadsum[i]);
+      exit(1);
+    }
+  }
+  if(read(fds[0], buf, N) != N){
+    printf("%s: threads didn't write\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    tid = thread_create(threadspin, 0);
+    write(fds[1], &tid, sizeof(tid));
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || read(fds[0], &tid, sizeof(tid)) != sizeof(tid) || tid < 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(n = 0; getrusage(tid, &ru) == tid && n < 10; n++)
+    sleep(1);
+  if(n == 10){
+    printf("%s: thread outlived its process\n", s);
+    exit(1);
+  }
+}
+
+static struct mutex mutexm;
+static struct cond mutexc;
+static int mutexcount, mutexready;
+
+static void
+mutexadd(void *arg)
+{
+  for(int k = 0; k < 10000; k++){
+    mutex_lock(&mutexm);
+    mutexcount++;
+    mutex_unlock(&mutexm);
+  }
+  mutex_lock(&mutexm);
+  while(!mutexready)
+    cond_wait(&mutexc, &mutexm);
+  mutexcount++;
+  mutex_unlock(&mutexm);
+}
+
+// futex(), and the mutexes and condition variables in ulib.c
+// built on it.
+void
+futexes(char *s)
+{
+  enum { N=4 };
+  int tids[N], i, v = 1;
+
+  if(futex(&v, FUTEX_WAIT, 0) != 0 || futex(&v, FUTEX_WAKE, 1) != 0){
+    printf("%s: futex failed\n", s);
+    exit(1);
+  }
+  if(futex((int*)0xffffffffffUL, FUTEX_WAKE, 1) != -1 ||
+     futex((int*)((char*)&v + 1), FUTEX_WAKE, 1) != -1){
+    printf("%s: futex on a bad address succeeded\n", s);
+    exit(1);
+  }
+
+  mutex_init(&mutexm);
+  cond_init(&mutexc);
+  mutexcount = mutexready = 0;
+  for(i = 0; i < N; i++){
+    if((tids[i] = thread_create(mutexadd, 0)) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  sleep(2);
+  mutex_lock(&mutexm);
+  mutexready = 1;
+  cond_broadcast(&mutexc);
+  mutex_unlock(&mutexm);
+  for(i = 0; i < N; i++){
+    if(thread_join(tids[i]) < 0){
+      printf("%s: thread_join failed\n", s);
+      exit(1);
+    }
+  }
+  if(mutexcount != N*10000 + N){
+    printf("%s: count %d, not %d\n", s, mutexcount, N*10000 + N);
+    exit(1);
+  }
+}
+
+// futex() between two processes that map the same file
+// MAP_SHARED on their own.
+void
+futexshared(char *s)
+{
+  int fd, i, pid, xstatus, *w;
+
+  fd = open("futexshared", O_CREATE|O_RDWR);
+  i = 0;
+  if(fd < 0 || write(fd, &i, sizeof(i)) != sizeof(i)){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  fd = open("futexshared", O_RDWR);
+  w = mmap(0, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(fd < 0 || w == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(pid == 0){
+    futex(w, FUTEX_WAIT, 0);
+    exit(0);
+  }
+  // the child may not be waiting yet.
+  for(i = 0; i < 100; i++){
+    if(futex(w, FUTEX_WAKE, 1) == 1)
+      break;
+    sleep(1);
+  }
+  if(i == 100){
+    printf("%s: child's futex not woken\n", s);
+    kill(pid);
+  }
+  wait(&xstatus);
+  munmap(w, sizeof(int));
+  unlink("futexshared");
+  if(i == 100 || xstatus != 0)
+    exit(1);
+}
+
+// spawn() a program with a pipe as its stdout, and check that
+// it gets only the fds it was given.
+void
+spawntest(char *s)
+{
+  char *echoargv[] = { "echo", "OK", 0 };
+  char *badargv[] = { "nosuchprog", 0 };
+  int fds[2], cfds[3], pid, xstatus, n;
+  char buf[8];
+
+  if(spawn("nosuchprog", badargv, 0) != -1){
+    printf("%s: spawn of a missing program succeeded\n", s);
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  cfds[0] = 0;
+  cfds[1] = fds[1];
+  cfds[2] = 2;
+  if((pid = spawn("echo", echoargv, cfds)) < 0){
+    printf("%s: spawn echo failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  // the child doesn't have the write end as fd 3 or more, so
+  // read sees end of file once echo exits.
+  n = 0;
+  while(n < sizeof(buf) && read(fds[0], buf + n, 1) == 1)
+    n++;
+  close(fds[0]);
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+  if(n != 3 || buf[0] != 'O' || buf[1] != 'K' || buf[2] != '\n'){
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+}
+
+// sleep() lasts as long as asked, including past the end of
+// the first level of the timer wheel.
+void
+sleeptime(char *s)
+{
+  static int n[] = { 1, 3, 66 };
+  int i, t0, t;
+
+  for(i = 0; i < sizeof(n)/sizeof(n[0]); i++){
+    t0 = uptime();
+    if(sleep(n[i]) < 0){
+      printf("%s: sleep failed\n", s);
+      exit(1);
+    }
+    t = uptime() - t0;
+    if(t < n[i] || t > n[i] + 2){
+      printf("%s: sleep(%d) took %d ticks\n", s, n[i], t);
+      exit(1);
+    }
+  }
+}
+
+int countfree();
+
+// fill more memory than the machine has, a page at a time so
+// that the heap isn't mapped with superpages, which are never
+// swapped out, and check that every page comes back intact.
+void
+swapping(char *s)
+{
+  int i, n, pid, xstatus;
+  char *a;
+
+  // countfree() counts swap slots too. leave room for
+  // page tables and for pages that can't be swapped out.
+  n = countfree() - 512;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a = sbrk(0);
+    for(i = 0; i < n; i++){
+      if(sbrk(PGSIZE) == (char*)0xffffffffffffffffL){
+        printf("%s: sbrk failed\n", s);
+        exit(1);
+      }
+      *(int*)(a + i*PGSIZE) = i;
+    }
+    for(i = 0; i < n; i++){
+      if(*(int*)(a + i*PGSIZE) != i){
+        printf("%s: page %d has wrong contents\n", s, i);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+}
+
 void
 sbrkbasic(char *s)
 {
@@ -2880,6 +3637,20 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {cowfork, "cowfork"},
+    {sbrksparse, "sbrksparse"},
+    {mmaptest, "mmaptest"},
+    {mmapshared, "mmapshared"},
+    {swapping, "swapping"},
+    {zeropage, "zeropage"},
+    {rusagetest, "rusage"},
+    {priority, "priority"},
+    {sleeptime, "sleeptime"},
+    {affinity, "affinity"},
+    {threads, "threads"},
+    {futexes, "futexes"},
+    {futexshared, "futexshared"},
+    {spawntest, "spawntest"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
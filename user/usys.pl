@@ -36,3 +36,11 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("mmap");
+entry("munmap");
+entry("getrusage");
+entry("setpriority");
+entry("setaffinity");
+entry("clone");
+entry("futex");
+entry("spawn");
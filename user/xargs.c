@@ -75,11 +75,10 @@ int main(int argc, const char *argv[])
 	while((new_argc = readline(argc - 1, new_argv)) != 0)
 	{
 		new_argv[new_argc] = 0;  //在尾后位置添加一个空指针，作为参数列表的结束标记
-		if(fork() == 0)
+		//spawn()直接从程序文件创建子进程，不必先fork()复制xargs自身
+		if(spawn(command, new_argv, 0) < 0)
 		{
-			exec(command, new_argv);
 			fprintf(2, "exec[%s] failed\n", command);
-			exit(1);
 		}else
 		{
 			wait(0);